@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+# Script to measure the accuracy/throughput trade-off of --lid-bytes.
+#
+# Usage: benchmark-lid.sh "2048 8192 32768" *.warc.gz
+# This will process the warcs once detecting language on whole documents,
+# which is used as reference, and once per sample size. For each run it
+# prints the elapsed time, documents per second, the percentage of
+# documents whose language matches the reference, and the percentage of
+# documents longer than the sample that fell back to whole-document
+# detection because the sample was unreliable or mixed.
+#
+set -euo pipefail
+
+SIZES=$1
+shift
+
+OUTPUT=$(mktemp -d ./lidXXXX)
+
+run() {
+	local NAME=$1
+	shift
+	local START=$(date +%s.%N)
+	${WARC2TEXT:-warc2text} -o $OUTPUT/$NAME.tsv.gz "$@" 2> $OUTPUT/$NAME.log
+	local END=$(date +%s.%N)
+	# url <tab> lang, sorted by url for joining
+	gzip -cd < $OUTPUT/$NAME.tsv.gz | cut -f1,4 | awk -F'\t' '{print $2"\t"$1}' | sort > $OUTPUT/$NAME.langs
+	awk "BEGIN {print $END - $START}" > $OUTPUT/$NAME.time
+}
+
+run full "$@"
+DOCS=$(wc -l < $OUTPUT/full.langs)
+FULL_TIME=$(cat $OUTPUT/full.time)
+
+# value of a statistic logged by warc2text, 0 if it is not there
+stat() {
+	grep -o "$2: [0-9]*" $OUTPUT/$1.log | awk '{s = $NF} END {print s + 0}'
+}
+
+printf "%-10s %10s %10s %10s %10s\n" "lid-bytes" "seconds" "docs/s" "agreement" "fallback"
+printf "%-10s %10.2f %10.1f %9.2f%% %10s\n" "full" $FULL_TIME $(awk "BEGIN {print $DOCS / $FULL_TIME}") 100 "-"
+
+for SIZE in $SIZES; do
+	run $SIZE --lid-bytes $SIZE "$@"
+	TIME=$(cat $OUTPUT/$SIZE.time)
+	SAME=$(join -t$'\t' $OUTPUT/full.langs $OUTPUT/$SIZE.langs | awk -F'\t' '$2 == $3' | wc -l)
+	SAMPLED=$(stat $SIZE "lid sampled records")
+	FALLBACK=$(stat $SIZE "lid fallback records")
+	printf "%-10s %10.2f %10.1f %9.2f%% %9.2f%%\n" $SIZE $TIME $(awk "BEGIN {print $DOCS / $TIME}") $(awk "BEGIN {print 100 * $SAME / $DOCS}") \
+		$(awk "BEGIN {print $SAMPLED + $FALLBACK ? 100 * $FALLBACK / ($SAMPLED + $FALLBACK) : 0}")
+done
+
+rm -r $OUTPUT
@@ -0,0 +1,138 @@
+#include "arrowwriter.hh"
+#include "compressor.hh"
+#include <boost/log/trivial.hpp>
+#ifdef WITH_ARROW
+#include <unordered_map>
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+#endif
+
+namespace warc2text {
+
+#ifdef WITH_ARROW
+    namespace {
+        void check(const arrow::Status& status, const std::string& filename) {
+            if (!status.ok())
+                throw WriteError("Error writing " + filename + ": " + status.ToString());
+        }
+
+        // html is the original payload, which need not be UTF-8
+        struct Batch {
+            arrow::StringBuilder url, lang, mime, date, digest, text;
+            arrow::BinaryBuilder html;
+            std::size_t rows = 0;
+            std::size_t bytes = 0;
+        };
+    }
+
+    struct ArrowWriter::Batches {
+        std::string filename;
+        bool html;
+        std::shared_ptr<arrow::Schema> schema;
+        std::shared_ptr<arrow::io::FileOutputStream> file;
+        std::shared_ptr<arrow::ipc::RecordBatchWriter> writer;
+        std::unordered_map<std::string, Batch> languages;
+
+        void flush(Batch& batch) {
+            if (batch.rows == 0) return;
+            std::vector<std::shared_ptr<arrow::Array>> columns(schema->num_fields());
+            arrow::ArrayBuilder* builders[] = {&batch.url, &batch.lang, &batch.mime, &batch.date, &batch.digest, &batch.text, &batch.html};
+            for (std::size_t i = 0; i < columns.size(); ++i)
+                check(builders[i]->Finish(&columns[i]), filename);
+            check(writer->WriteRecordBatch(*arrow::RecordBatch::Make(schema, batch.rows, columns)), filename);
+            batch.rows = 0;
+            batch.bytes = 0;
+        }
+    };
+
+    ArrowWriter::ArrowWriter(const std::string& filename, bool html) : batches(new Batches()) {
+        batches->filename = filename;
+        batches->html = html;
+        arrow::FieldVector fields = {
+            arrow::field("url", arrow::utf8()),
+            arrow::field("lang", arrow::utf8()),
+            arrow::field("mime", arrow::utf8()),
+            arrow::field("date", arrow::utf8()),
+            arrow::field("digest", arrow::utf8()),
+            arrow::field("text", arrow::utf8())
+        };
+        if (html) fields.push_back(arrow::field("html", arrow::binary()));
+        batches->schema = arrow::schema(fields);
+
+        auto file = arrow::io::FileOutputStream::Open(filename);
+        check(file.status(), filename);
+        batches->file = *file;
+        auto writer = arrow::ipc::MakeFileWriter(batches->file, batches->schema);
+        check(writer.status(), filename);
+        batches->writer = *writer;
+    }
+
+    ArrowWriter::~ArrowWriter() {
+        try {
+            close();
+        } catch (const WriteError& e) {
+            BOOST_LOG_TRIVIAL(error) << e.what();
+        }
+    }
+
+    void ArrowWriter::write(const Record& record, bool multilang) {
+        if (not multilang) {
+            write(record, record.getLanguage(), record.getPlainText());
+            return;
+        }
+        for (const std::string& lang : spanLanguages(record.getLanguageSpans())) {
+            std::string text;
+            for (const LanguageSpan& span : record.getLanguageSpans())
+                if (span.lang == lang)
+                    text.append(record.getPlainText(), span.offset, span.length);
+            write(record, lang, text);
+        }
+    }
+
+    void ArrowWriter::write(const Record& record, const std::string& lang, const std::string& text) {
+        Batch& batch = batches->languages[lang];
+        const std::string& filename = batches->filename;
+        check(batch.url.Append(record.getURL()), filename);
+        check(batch.lang.Append(lang), filename);
+        check(batch.mime.Append(record.getHTTPcontentType()), filename);
+        check(batch.date.Append(record.getHeaderProperty("WARC-Date")), filename);
+        check(batch.digest.Append(record.getHeaderProperty("WARC-Block-Digest")), filename);
+        check(batch.text.Append(text), filename);
+        batch.bytes += record.getURL().size() + text.size();
+        if (batches->html) {
+            check(batch.html.Append(record.getPayload()), filename);
+            batch.bytes += record.getPayload().size();
+        }
+        // batches also stay well below the 2GB limit of 32-bit string offsets
+        if (++batch.rows >= BATCH_ROWS or batch.bytes >= BATCH_BYTES)
+            batches->flush(batch);
+    }
+
+    void ArrowWriter::close() {
+        if (!batches->writer) return;
+        std::shared_ptr<arrow::ipc::RecordBatchWriter> writer = batches->writer;
+        for (auto& it : batches->languages)
+            batches->flush(it.second);
+        batches->languages.clear();
+        batches->writer.reset();
+        check(writer->Close(), batches->filename);
+        check(batches->file->Close(), batches->filename);
+    }
+#else
+    struct ArrowWriter::Batches {};
+
+    ArrowWriter::ArrowWriter(const std::string&, bool) {
+        throw WriteError("warc2text was built without Arrow support");
+    }
+
+    ArrowWriter::~ArrowWriter() {}
+
+    void ArrowWriter::write(const Record&, bool) {}
+
+    void ArrowWriter::write(const Record&, const std::string&, const std::string&) {}
+
+    void ArrowWriter::close() {}
+#endif
+
+}
@@ -0,0 +1,34 @@
+#ifndef WARC2TEXT_ARROWWRITER_HH
+#define WARC2TEXT_ARROWWRITER_HH
+
+#include <memory>
+#include <string>
+#include "record.hh"
+
+namespace warc2text {
+
+    // writes documents to an Arrow IPC file with columns url, lang, mime, date, digest, text and optionally html
+    // rows are collected per language, so every record batch holds a single language
+    // the arrow headers stay in arrowwriter.cc, as they need a newer C++ standard than the rest of warc2text
+    class ArrowWriter {
+        private:
+            struct Batches;
+            std::unique_ptr<Batches> batches;
+            void write(const Record& record, const std::string& lang, const std::string& text);
+
+        public:
+            // all methods throw WriteError if writing fails, or if warc2text was built without Arrow
+            ArrowWriter(const std::string& filename, bool html);
+            ~ArrowWriter();
+            // one row per language of the record, like the text output: with multilang, a row per language
+            // of its spans, with the text of those spans
+            void write(const Record& record, bool multilang);
+            // write the remaining batches and the file footer
+            void close();
+            static const std::size_t BATCH_ROWS = 8192;
+            static const std::size_t BATCH_BYTES = 64 * 1024 * 1024;
+    };
+
+}
+
+#endif
@@ -1,174 +1,486 @@
 #include "bilangwriter.hh"
 #include "util.hh"
-#include <cassert>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
 #include <string>
+#include <boost/log/trivial.hpp>
 
 namespace warc2text{
 
-    GzipWriter::GzipWriter() {
+    CompressedWriter::CompressedWriter() {
         dest = nullptr;
-        compressed = 0;
-        s.zalloc = nullptr;
-        s.zfree = nullptr;
-        s.opaque = nullptr;
-        int ret = deflateInit2(&s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY);
-        assert(ret == Z_OK);
-        buf = new unsigned char[BUFFER_SIZE];
+        pool = nullptr;
+        atomic = false;
+        input_size = 0;
+        output_size = 0;
     }
 
-    GzipWriter::~GzipWriter() {
-        if (dest) {
-            this->compress("", 0, Z_FINISH);
-            deflateEnd(&s);
-            std::fclose(dest);
+    CompressedWriter::~CompressedWriter() {
+        try {
+            close();
+        } catch (const WriteError& e) {
+            BOOST_LOG_TRIVIAL(error) << e.what();
         }
-        delete[] buf;
     }
 
-    void GzipWriter::compress(const char *in, std::size_t size, int flush) {
-        if (size == 0 && flush == Z_NO_FLUSH) return;
-        s.avail_in = size;
-        s.next_in = (Bytef *) in;
-        s.avail_out = 0;
-        s.next_out = buf;
-        int ret = Z_OK;
-        //std::size_t written;
-        while (s.avail_out == 0) {
-            s.avail_out = BUFFER_SIZE;
-            s.next_out = buf;
-            ret = deflate(&s, flush);
-            assert(ret == Z_OK || ret == Z_STREAM_END); // Z_STREAM_END only happens if flush == Z_FINISH
-            compressed = BUFFER_SIZE - s.avail_out;
-            //written = std::fwrite(buf, 1, compressed, dest);
-            std::fwrite(buf, 1, compressed, dest);
-            // TODO error handling
-            // if (written != compressed || std::ferror(dest)) {
-            // }
+    // compress a block as a complete gzip member or frame
+    std::string compressBlock(const std::string& block, const Codec& codec) {
+        std::string out;
+        std::unique_ptr<Compressor> compressor = makeCompressor(codec);
+        compressor->compress(block.data(), block.size(), out);
+        compressor->finish(out);
+        return out;
+    }
+
+    void CompressedWriter::submitBlock() {
+        if (staging.empty()) return;
+        std::shared_ptr<std::string> input = std::make_shared<std::string>();
+        input->swap(staging);
+        staging.reserve(BLOCK_SIZE + STAGING_SIZE);
+        Codec block_codec = codec;
+        pending.push_back(pool->submit([input, block_codec]() { return compressBlock(*input, block_codec); }));
+        // write what is already done, and do not let more than two blocks per thread pile up
+        writePending(2 * pool->size());
+    }
+
+    // write finished blocks in order, waiting until at most max_pending are left
+    void CompressedWriter::writePending(std::size_t max_pending) {
+        while (!pending.empty()) {
+            if (pending.size() <= max_pending && pending.front().wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                break;
+            std::string member;
+            try {
+                member = pending.front().get();
+            } catch (const WriteError& e) {
+                pending.pop_front();
+                throw WriteError("Error compressing " + path + ": " + e.what());
+            }
+            pending.pop_front();
+            writeOut(member);
+        }
+    }
+
+    void CompressedWriter::writeOut(const std::string& data) {
+        if (std::fwrite(data.data(), 1, data.size(), dest) != data.size())
+            throw WriteError("Error writing to " + path + ": " + std::strerror(errno));
+        output_size += data.size();
+    }
+
+    void CompressedWriter::compress(const char *in, std::size_t size) {
+        if (size == 0) return;
+        out.clear();
+        try {
+            compressor->compress(in, size, out);
+        } catch (const WriteError& e) {
+            throw WriteError("Error compressing " + path + ": " + e.what());
         }
-        assert(s.avail_in == 0);
+        writeOut(out);
+    }
+
+    void CompressedWriter::open(const std::string& filename, const Codec& codec, util::ThreadPool* pool, bool append, bool atomic) {
+        this->filename = filename;
+        this->path = atomic ? filename + ".tmp" : filename;
+        this->atomic = atomic;
+        this->codec = codec;
+        this->pool = pool;
+        input_size = 0;
+        output_size = 0;
+        if (filename == "-") {
+            this->path = "standard output";
+            this->atomic = false;
+            dest = stdout;
+        } else {
+            dest = std::fopen(path.c_str(), append ? "ab" : "wb");
+        }
+        if (!dest)
+            throw WriteError("Could not open " + path + ": " + std::strerror(errno));
+        if (!pool) compressor = makeCompressor(codec);
+        staging.reserve(pool ? BLOCK_SIZE + STAGING_SIZE : STAGING_SIZE);
+    }
+
+    void CompressedWriter::write(const char* text, std::size_t size) {
+        input_size += size;
+        if (pool) {
+            staging.append(text, size);
+            return;
+        }
+        // small writes are collected, so that the compressor gets large contiguous inputs
+        if (staging.size() + size > STAGING_SIZE) {
+            this->compress(staging.data(), staging.size());
+            staging.clear();
+        }
+        if (size >= STAGING_SIZE)
+            this->compress(text, size);
+        else
+            staging.append(text, size);
+    }
+
+    void CompressedWriter::writeLine(const char* text, std::size_t size) {
+        this->write(text, size);
+        this->writeRecordEnd("\n", 1);
+    }
+
+    void CompressedWriter::writeRecordEnd(const char* text, std::size_t size) {
+        this->write(text, size);
+        // blocks are only cut after complete records
+        if (pool && staging.size() >= BLOCK_SIZE) submitBlock();
     }
 
-    void GzipWriter::open(const std::string& filename) {
-        dest = std::fopen(filename.c_str(), "wb");
+    void CompressedWriter::write(const std::string& text) {
+        this->write(text.c_str(), text.size());
     }
 
-    void GzipWriter::write(const char* text, std::size_t size) {
-        this->compress(text, size, Z_NO_FLUSH);
+    void CompressedWriter::writeLine(const std::string& text) {
+        this->writeLine(text.c_str(), text.size());
     }
 
-    void GzipWriter::writeLine(const char* text, std::size_t size) {
-        this->compress(text, size, Z_NO_FLUSH);
-        this->compress("\n", 1, Z_NO_FLUSH);
+    void CompressedWriter::writeBase64(util::Base64Encoder& encoder, const char* text, std::size_t size) {
+        while (size > 0) {
+            std::size_t chunk = std::min(size, BASE64_CHUNK);
+            // room for the encoded chunk, plus a group completed with bytes left over from the previous call
+            if (!pool && staging.size() + chunk / 3 * 4 + 4 > STAGING_SIZE) {
+                this->compress(staging.data(), staging.size());
+                staging.clear();
+            }
+            std::size_t staged = staging.size();
+            encoder.encode(text, chunk, staging);
+            input_size += staging.size() - staged;
+            text += chunk;
+            size -= chunk;
+        }
     }
 
-    void GzipWriter::write(const std::string& text) {
-        this->compress(text.c_str(), text.size(), Z_NO_FLUSH);
+    void CompressedWriter::flush() {
+        if (!dest) return;
+        if (pool) {
+            submitBlock();
+            writePending(0);
+        } else {
+            this->compress(staging.data(), staging.size());
+            staging.clear();
+            out.clear();
+            compressor->flush(out);
+            writeOut(out);
+        }
+        if (std::fflush(dest) != 0)
+            throw WriteError("Error writing to " + path + ": " + std::strerror(errno));
     }
 
-    void GzipWriter::writeLine(const std::string& text) {
-        this->compress(text.c_str(), text.size(), Z_NO_FLUSH);
-        this->compress("\n", 1, Z_NO_FLUSH);
+    void CompressedWriter::close() {
+        if (!dest) return;
+        // release everything even if finishing the stream fails, and report the error afterwards
+        std::exception_ptr error;
+        try {
+            if (pool) {
+                submitBlock();
+                writePending(0);
+            } else {
+                this->compress(staging.data(), staging.size());
+                out.clear();
+                compressor->finish(out);
+                writeOut(out);
+            }
+        } catch (const WriteError&) {
+            error = std::current_exception();
+        }
+        compressor.reset();
+        pending.clear();
+        staging.clear();
+        out.clear();
+        // standard output stays open, but everything has to reach it
+        int ret = dest == stdout ? std::fflush(dest) : std::fclose(dest);
+        dest = nullptr;
+        if (error)
+            std::rethrow_exception(error);
+        if (ret != 0)
+            throw WriteError("Error closing " + path + ": " + std::strerror(errno));
+        // only complete files get their final name
+        if (atomic and std::rename(path.c_str(), filename.c_str()) != 0)
+            throw WriteError("Error renaming " + path + " to " + filename + ": " + std::strerror(errno));
     }
 
-    bool GzipWriter::is_open(){
+    bool CompressedWriter::is_open(){
         return dest != nullptr;
     }
 
-    void BilangWriter::write(const std::string& lang, const std::string& b64text, const std::string& url, const std::string& mime, const std::string& b64html) {
-        GzipWriter* gzurl = &url_files[lang];
-        GzipWriter* gztext = &text_files[lang];
-        GzipWriter* gzmime = nullptr;
-        GzipWriter* gzhtml = nullptr;
-        if (output_files.count("mime") == 1) gzmime = &(mime_files[lang]);
-        if (output_files.count("html") == 1) gzhtml = &(html_files[lang]);
-        if (!gzurl->is_open()) {
-            // if one file does not exist, the rest shouldn't either
-            std::string path = folder + "/" + lang;
-            util::createDirectories(path);
-            gzurl->open(path + "/url.gz");
-            gztext->open(path + "/text.gz");
-            if (gzmime != nullptr) gzmime->open(path + "/mime.gz");
-            if (gzhtml != nullptr) gzhtml->open(path + "/html.gz");
+    DocumentWriter::DocumentWriter(CompressedWriter& dest, bool paragraph_identification, TextFormat format) :
+        dest(dest),
+        format(format),
+        encoder(),
+        chunk(),
+        paragraph_identification(paragraph_identification),
+        paragraph(0),
+        empty_paragraphs(0),
+        in_paragraph(false) {}
+
+    void DocumentWriter::encode(const char* text, std::size_t size) {
+        if (format == TextFormat::BASE64) {
+            dest.writeBase64(encoder, text, size);
+            return;
         }
+        if (chunk.size() + size > CHUNK_SIZE) {
+            writeChunk(chunk.data(), chunk.size());
+            chunk.clear();
+        }
+        if (size >= CHUNK_SIZE)
+            writeChunk(text, size);
+        else
+            chunk.append(text, size);
+    }
 
-        gzurl->writeLine(url);
-        gztext->writeLine(b64text);
-        if (gzmime != nullptr) gzmime->writeLine(mime);
-        if (gzhtml != nullptr) gzhtml->writeLine(b64html);
+    // a chunk is its length as an unsigned LEB128 number followed by its bytes
+    void DocumentWriter::writeChunk(const char* data, std::size_t size) {
+        if (size == 0) return;
+        char header[10];
+        std::size_t header_size = 0;
+        for (std::size_t length = size; ; length >>= 7) {
+            header[header_size++] = (length & 0x7f) | (length >= 0x80 ? 0x80 : 0);
+            if (length < 0x80) break;
+        }
+        dest.write(header, header_size);
+        dest.write(data, size);
     }
 
-    std::string get_paragraph_id(const std::string& text) {
-        std::string result = "";
-        std::vector<std::string> lines = util::split(text, "\n");
+    void DocumentWriter::endParagraph() {
+        std::string id = "\t" + std::to_string(paragraph++) + "\n";
+        encode(id.data(), id.size());
+    }
 
-        while (lines[lines.size() - 1] == "") {
-            lines.pop_back();
+    void DocumentWriter::write(const char* text, std::size_t size) {
+        if (not paragraph_identification) {
+            encode(text, size);
+            return;
+        }
+        const char* end = text + size;
+        while (text < end) {
+            const char* newline = static_cast<const char*>(std::memchr(text, '\n', end - text));
+            const char* line_end = newline ? newline : end;
+            if (line_end > text) {
+                // empty lines only get an index if they are followed by a non-empty one
+                for (; empty_paragraphs > 0; --empty_paragraphs)
+                    endParagraph();
+                encode(text, line_end - text);
+                in_paragraph = true;
+            }
+            if (!newline) break;
+            if (in_paragraph) endParagraph();
+            else ++empty_paragraphs;
+            in_paragraph = false;
+            text = newline + 1;
         }
+    }
 
-        for (size_t i = 0; i < lines.size(); ++i) {
-            result += lines[i] + "\t" + std::to_string(i) + "\n";
+    void DocumentWriter::finish() {
+        if (in_paragraph) endParagraph();
+        if (format == TextFormat::BASE64) {
+            std::string tail;
+            encoder.finish(tail);
+            dest.writeLine(tail);
+        } else {
+            writeChunk(chunk.data(), chunk.size());
+            chunk.clear();
+            // an empty chunk ends the frame
+            dest.writeRecordEnd("\0", 1);
         }
+        paragraph = 0;
+        empty_paragraphs = 0;
+        in_paragraph = false;
+    }
 
-        return result;
+    // numbers go before the extensions of the file name: out.tsv.gz becomes out.3.tsv.gz
+    std::string numberedFilename(const std::string& filename, std::size_t number) {
+        std::size_t name = filename.rfind('/');
+        name = name == std::string::npos ? 0 : name + 1;
+        std::size_t extension = filename.find('.', name + 1);
+        if (extension == std::string::npos) extension = filename.size();
+        return filename.substr(0, extension) + "." + std::to_string(number) + filename.substr(extension);
     }
 
-    void BilangWriter::write(const Record& record, bool multilang, bool paragraph_identification) {
-        std::string base64text;
-        std::string base64html;
+    bool RotationOptions::full(const CompressedWriter& writer, std::size_t part_records) const {
+        return (bytes > 0 and writer.outputSize() >= bytes)
+            or (input_bytes > 0 and writer.inputSize() >= input_bytes)
+            or (records > 0 and part_records >= records);
+    }
 
-        if (multilang) {
+    std::size_t BilangWriter::shard(const Record& record) const {
+        if (shards <= 1) return 0;
+        if (shard_key == ShardKey::HOST)
+            return util::hashBytes(util::getHost(record.getURL())) % shards;
+        return util::hashBytes(record.getURL()) % shards;
+    }
 
-            if (output_files.count("html") == 1)
-                util::encodeBase64(record.getPayload(), base64html);
+    void BilangWriter::openFolder(const std::string& subfolder) {
+        auto position = open_folder_positions.find(subfolder);
+        if (position != open_folder_positions.end()) {
+            open_folders.splice(open_folders.begin(), open_folders, position->second);
+            return;
+        }
+        if (max_open_languages > 0 and open_folders.size() >= max_open_languages) {
+            // a copy, as closing removes it from the list
+            std::string least_recent = open_folders.back();
+            closeFolder(least_recent);
+        }
 
-            for (const auto& it : record.getTextByLangs()) {
-                std::string payload = it.second;
+        // files are created the first time a folder is used, and appended to when it is opened again
+        // unless they are rotated, as finished parts are never modified
+        bool created = created_folders.count(subfolder) == 1;
+        bool append = created and not rotation.enabled();
+        std::string path = folder + "/" + subfolder;
+        if (!created) util::createDirectories(path);
+        std::vector<std::pair<std::string, std::unordered_map<std::string, CompressedWriter>*>> files = {{"url", &url_files}, {"text", &text_files}};
+        if (output_files.count("mime") == 1) files.emplace_back("mime", &mime_files);
+        if (output_files.count("html") == 1) files.emplace_back("html", &html_files);
+        for (auto& file : files) {
+            const Codec& codec = compression.get(file.first);
+            std::string filename = path + "/" + file.first + codec.extension();
+            if (rotation.enabled())
+                filename = numberedFilename(filename, folder_parts[subfolder]);
+            (*file.second)[subfolder].open(filename, codec, pool.get(), append, rotation.enabled());
+        }
+        folder_records[subfolder] = 0;
+        created_folders.insert(subfolder);
+        open_folders.push_front(subfolder);
+        open_folder_positions[subfolder] = open_folders.begin();
+    }
 
-                if (paragraph_identification) {
-                    payload = get_paragraph_id(payload);
-                }
+    void BilangWriter::closeFolder(const std::string& subfolder) {
+        open_folders.erase(open_folder_positions.at(subfolder));
+        open_folder_positions.erase(subfolder);
+        // the writers are removed, so that a closed folder keeps no buffers
+        for (auto* files : {&url_files, &mime_files, &text_files, &html_files}) {
+            auto it = files->find(subfolder);
+            if (it == files->end()) continue;
+            it->second.close();
+            files->erase(it);
+        }
+        if (rotation.enabled())
+            ++folder_parts[subfolder];
+    }
 
-                util::encodeBase64(payload, base64text);
-                this->write(it.first, base64text, record.getURL(), record.getHTTPcontentType(), base64html);
-            }
+    // a part is finished when any of its files reaches the limits
+    bool BilangWriter::folderFull(const std::string& subfolder) const {
+        std::size_t records = folder_records.at(subfolder);
+        for (auto* files : {&url_files, &mime_files, &text_files, &html_files}) {
+            auto it = files->find(subfolder);
+            if (it != files->end() and rotation.full(it->second, records))
+                return true;
+        }
+        return false;
+    }
 
-        } else {
-            std::string payload = record.getPlainText();
+    void BilangWriter::write(const std::string& subfolder, const std::string& lang, const std::string& text, const std::vector<LanguageSpan>& spans,
+                             const std::string& url, const std::string& mime, const std::string& html, bool paragraph_identification) {
+        openFolder(subfolder);
+        CompressedWriter* gzurl = &url_files[subfolder];
+        CompressedWriter* gztext = &text_files[subfolder];
+        CompressedWriter* gzmime = output_files.count("mime") == 1 ? &mime_files[subfolder] : nullptr;
+        CompressedWriter* gzhtml = output_files.count("html") == 1 ? &html_files[subfolder] : nullptr;
 
-            if (paragraph_identification) {
-                payload = get_paragraph_id(payload);
-            }
+        gzurl->writeLine(url);
+        // the text of this language is the concatenation of its spans
+        DocumentWriter text_writer(*gztext, paragraph_identification, format);
+        for (const LanguageSpan& span : spans)
+            if (span.lang == lang)
+                text_writer.write(text.data() + span.offset, span.length);
+        text_writer.finish();
+        if (gzmime != nullptr) gzmime->writeLine(mime);
+        if (gzhtml != nullptr) {
+            DocumentWriter html_writer(*gzhtml, false, format);
+            html_writer.write(html.data(), html.size());
+            html_writer.finish();
+        }
+
+        if (rotation.enabled()) {
+            ++folder_records[subfolder];
+            if (folderFull(subfolder))
+                closeFolder(subfolder);
+        }
+    }
+
+    void BilangWriter::write(const Record& record, bool multilang, bool paragraph_identification) {
+        // all languages of a record go to the same shard
+        std::string shard_folder = shards > 1 ? "/" + std::to_string(shard(record)) : "";
+        if (multilang) {
+            // one line per language, with the spans of that language in document order
+            for (const std::string& lang : spanLanguages(record.getLanguageSpans()))
+                this->write(lang + shard_folder, lang, record.getPlainText(), record.getLanguageSpans(), record.getURL(), record.getHTTPcontentType(), record.getPayload(), paragraph_identification);
+        } else {
+            const std::vector<LanguageSpan> spans = {{record.getLanguage(), 0, record.getPlainText().size()}};
+            this->write(record.getLanguage() + shard_folder, record.getLanguage(), record.getPlainText(), spans, record.getURL(), record.getHTTPcontentType(), record.getPayload(), paragraph_identification);
+        }
+    }
 
-            util::encodeBase64(payload, base64text);
+    const std::vector<std::string> BilangWriter::DEFAULT_TSV_COLUMNS = {"lang", "date", "digest", "url", "text"};
 
-            if (output_files.count("html") == 1)
-                util::encodeBase64(record.getPayload(), base64html);
+    bool BilangWriter::validTSVColumns(const std::vector<std::string>& columns, std::string& error) {
+        static const std::unordered_set<std::string> metadata = {"lang", "date", "digest", "url", "mime", "simhash"};
+        if (columns.empty() or (columns.back() != "text" and columns.back() != "html")) {
+            error = "the last column has to be text or html";
+            return false;
+        }
+        for (std::size_t i = 0; i + 1 < columns.size(); ++i) {
+            if (metadata.count(columns[i]) == 0) {
+                error = "unknown column '" + columns[i] + "', only the last column can be text or html";
+                return false;
+            }
+        }
+        return true;
+    }
 
-            this->write(record.getLanguage(), base64text, record.getURL(), record.getHTTPcontentType(), base64html);
+    static std::string tsvColumn(const Record& record, const std::string& column) {
+        if (column == "lang") return record.getLanguage();
+        if (column == "date") return record.getHeaderProperty("WARC-Date");
+        if (column == "digest") return record.getHeaderProperty("WARC-Block-Digest");
+        if (column == "url") return record.getURL();
+        if (column == "simhash") {
+            char hex[17];
+            std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(record.getSimHash()));
+            return hex;
         }
+        return record.getHTTPcontentType();
     }
 
     void BilangWriter::write_tsv(const Record& record) {
+        std::size_t tsv_shard = shard(record);
+        CompressedWriter& tsv_writer = tsv_files[tsv_shard];
         if (!tsv_writer.is_open()) {
-            tsv_writer.open(folder);
+            // with both, files are named out.<shard>.<part>.tsv.gz
+            std::string filename = rotation.enabled() ? numberedFilename(folder, tsv_parts[tsv_shard]) : folder;
+            if (shards > 1) filename = numberedFilename(filename, tsv_shard);
+            tsv_writer.open(filename, compression.get("tsv"), pool.get(), false, rotation.enabled());
+            tsv_records[tsv_shard] = 0;
         }
 
-        std::string payload = record.getPlainText();
-        std::string base64text;
-        util::encodeBase64(payload, base64text);
-        std::string language;
-        warc2text::detectLanguage(payload, language);
+        std::string metadata;
+        for (std::size_t i = 0; i + 1 < tsv_columns.size(); ++i) {
+            metadata += tsvColumn(record, tsv_columns[i]);
+            metadata += '\t';
+        }
+        DocumentWriter text_writer(tsv_writer, false, format);
+        // a framed document carries its metadata columns inside the frame, before the text
+        if (format == TextFormat::FRAMED)
+            text_writer.write(metadata.data(), metadata.size());
+        else
+            tsv_writer.write(metadata);
+        const std::string& document = tsv_columns.back() == "html" ? record.getPayload() : record.getPlainText();
+        text_writer.write(document.data(), document.size());
+        text_writer.finish();
+
+        if (rotation.enabled() and rotation.full(tsv_writer, ++tsv_records[tsv_shard])) {
+            tsv_writer.close();
+            ++tsv_parts[tsv_shard];
+        }
+    }
 
-        tsv_writer.write(language);
-        tsv_writer.write("\t");
-        tsv_writer.write(record.getHeaderProperty("WARC-Date"));
-        tsv_writer.write("\t");
-        tsv_writer.write(record.getHeaderProperty("WARC-Block-Digest"));
-        tsv_writer.write("\t");
-        tsv_writer.write(record.getURL());
-        tsv_writer.write("\t");
-        tsv_writer.writeLine(base64text);
+    void BilangWriter::close() {
+        for (auto& it : tsv_files)
+            it.second.close();
+        for (auto* files : {&url_files, &mime_files, &text_files, &html_files})
+            for (auto& it : *files)
+                it.second.close();
     }
 
 }
-
@@ -1,69 +1,223 @@
 #ifndef WARC2TEXT_WRITER_HH
 #define WARC2TEXT_WRITER_HH
 
+#include <deque>
+#include <future>
+#include <list>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
+#include "compressor.hh"
 #include "lang.hh"
 #include "record.hh"
-#include "zlib.h"
+#include "threadpool.hh"
 
 namespace warc2text {
 
-    class GzipWriter {
+    class CompressedWriter {
         private:
             FILE* dest;
-            z_stream s{};
-            unsigned char* buf;
-            std::size_t compressed;
-            void compress(const char* in, std::size_t size, int flush);
+            std::string filename;
+            // file actually written, filename with a temporary suffix until it is closed if atomic
+            std::string path;
+            bool atomic;
+            std::size_t input_size;
+            std::size_t output_size;
+            Codec codec;
+            std::unique_ptr<Compressor> compressor;
+            std::string out;
+            // small writes are collected here, so that the compressor gets large contiguous inputs
+            // with a thread pool, it collects blocks of whole lines that are compressed in parallel
+            // as independent gzip members (or frames), and written in order
+            std::string staging;
+            util::ThreadPool* pool;
+            std::deque<std::future<std::string>> pending;
+            void compress(const char* in, std::size_t size);
+            void writeOut(const std::string& data);
+            void submitBlock();
+            void writePending(std::size_t max_pending);
 
         public:
-            GzipWriter();
-            ~GzipWriter();
-            void open(const std::string& filename);
+            CompressedWriter();
+            ~CompressedWriter();
+            // all methods throw WriteError if compression or writing fails
+            // with append, the output is added to the end of an existing file as a new gzip member (or frame)
+            // with atomic, the output is written to filename.tmp, which is renamed to filename when successfully closed
+            // filename "-" writes to standard output
+            void open(const std::string& filename, const Codec& codec = Codec(), util::ThreadPool* pool = nullptr,
+                      bool append = false, bool atomic = false);
             void write(const char* text, std::size_t size);
             void writeLine(const char* text, std::size_t size);
             void write(const std::string& text);
             void writeLine(const std::string& text);
+            // write the end of a record, the output can be split in blocks after it
+            void writeRecordEnd(const char* text, std::size_t size);
+            // base64 encode text straight into the staging buffer, in chunks, so no full encoded copy is made
+            void writeBase64(util::Base64Encoder& encoder, const char* text, std::size_t size);
+            // compress and write everything written so far, the file is then a valid compressed prefix
+            void flush();
+            // finish the compressed stream and close the file
+            void close();
             bool is_open();
-            static const std::size_t BUFFER_SIZE = 4096;
+            // bytes written to the writer since it was opened, and compressed bytes written to the file so far
+            std::size_t inputSize() const { return input_size; };
+            std::size_t outputSize() const { return output_size; };
+            static const std::size_t STAGING_SIZE = 256 * 1024;
+            static const std::size_t BLOCK_SIZE = 1024 * 1024;
+            static const std::size_t BASE64_CHUNK = 48 * 1024;
     };
 
+    // how documents are written: as a base64 line, or as a frame of raw UTF-8 (see framereader.hh)
+    enum class TextFormat { BASE64, FRAMED };
+
+    // writes a document as a single base64 line or frame, fed in pieces so no full copy of the text or its encoding is needed
+    // with paragraph identification, each line of the document gets its index appended as a tab separated column
+    class DocumentWriter {
+        private:
+            CompressedWriter& dest;
+            TextFormat format;
+            util::Base64Encoder encoder;
+            // small pieces of a frame are collected here, so that chunk headers stay rare
+            std::string chunk;
+            bool paragraph_identification;
+            std::size_t paragraph;
+            std::size_t empty_paragraphs;
+            bool in_paragraph;
+
+            void encode(const char* text, std::size_t size);
+            void writeChunk(const char* data, std::size_t size);
+            void endParagraph();
+
+        public:
+            DocumentWriter(CompressedWriter& dest, bool paragraph_identification, TextFormat format = TextFormat::BASE64);
+            void write(const char* text, std::size_t size);
+            void finish();
+            static const std::size_t CHUNK_SIZE = 65536;
+    };
+
+    // limits after which output files are finished and the next numbered part is started, 0 for no limit
+    // bytes is the compressed size of any file of a part, input_bytes its uncompressed size
+    struct RotationOptions {
+        std::size_t bytes;
+        std::size_t input_bytes;
+        std::size_t records;
+
+        RotationOptions() : bytes(0), input_bytes(0), records(0) {};
+        bool enabled() const { return bytes > 0 or input_bytes > 0 or records > 0; };
+        bool full(const CompressedWriter& writer, std::size_t part_records) const;
+    };
+
+    // what records are sharded by, so that documents of a host can be kept together
+    enum class ShardKey { URL, HOST };
+
     class BilangWriter {
         private:
             std::string folder;
-            GzipWriter tsv_writer;
-            std::unordered_map<std::string, GzipWriter> url_files;
-            std::unordered_map<std::string, GzipWriter> mime_files;
-            std::unordered_map<std::string, GzipWriter> text_files;
-            std::unordered_map<std::string, GzipWriter> html_files;
+            // declared before the writers, so it outlives them
+            std::unique_ptr<util::ThreadPool> pool;
+            CompressionOptions compression;
+            std::unordered_map<std::size_t, CompressedWriter> tsv_files;
+            std::unordered_map<std::string, CompressedWriter> url_files;
+            std::unordered_map<std::string, CompressedWriter> mime_files;
+            std::unordered_map<std::string, CompressedWriter> text_files;
+            std::unordered_map<std::string, CompressedWriter> html_files;
             std::unordered_set<std::string> output_files;
+            TextFormat format;
+            std::size_t shards;
+            ShardKey shard_key;
+            // current part and its number of records, of every language folder and tsv shard
+            RotationOptions rotation;
+            std::unordered_map<std::string, std::size_t> folder_parts;
+            std::unordered_map<std::string, std::size_t> folder_records;
+            std::unordered_map<std::size_t, std::size_t> tsv_parts;
+            std::unordered_map<std::size_t, std::size_t> tsv_records;
+            std::vector<std::string> tsv_columns;
+            // language folders (every shard is one) with open files, most recently used first,
+            // bounded by max_open_languages (0 for no limit)
+            std::size_t max_open_languages;
+            std::list<std::string> open_folders;
+            std::unordered_map<std::string, std::list<std::string>::iterator> open_folder_positions;
+            std::unordered_set<std::string> created_folders;
 
-            void write(const std::string& lang, const std::string& b64text, const std::string& url, const std::string& mime, const std::string& b64html);
+            std::size_t shard(const Record& record) const;
+            void openFolder(const std::string& subfolder);
+            void closeFolder(const std::string& subfolder);
+            bool folderFull(const std::string& subfolder) const;
+            void write(const std::string& subfolder, const std::string& lang, const std::string& text, const std::vector<LanguageSpan>& spans,
+                       const std::string& url, const std::string& mime, const std::string& html, bool paragraph_identification);
 
         public:
+            // tsv columns, the last one is the document (text or html) and the rest are any of lang, date, digest, url,
+            // mime and simhash
+            static const std::vector<std::string> DEFAULT_TSV_COLUMNS;
+            // check a list of tsv columns, setting error if it is not valid
+            static bool validTSVColumns(const std::vector<std::string>& columns, std::string& error);
+
             explicit BilangWriter(const std::string& folder) :
                 folder(folder),
-                tsv_writer(),
+                pool(),
+                compression(),
+                tsv_files(),
                 url_files(),
                 mime_files(),
                 text_files(),
                 html_files(),
-                output_files({}) // url and text are mandatory regardless
+                output_files({}), // url and text are mandatory regardless
+                format(TextFormat::BASE64),
+                shards(1),
+                shard_key(ShardKey::URL),
+                rotation(),
+                folder_parts(),
+                folder_records(),
+                tsv_parts(),
+                tsv_records(),
+                tsv_columns(DEFAULT_TSV_COLUMNS),
+                max_open_languages(0),
+                open_folders(),
+                open_folder_positions(),
+                created_folders()
             {};
 
-            explicit BilangWriter(const std::string& folder, const std::unordered_set<std::string>& output_files) :
+            // with compression.threads > 0, outputs are compressed in parallel blocks
+            // with max_open_languages > 0, the files of the least recently used language are closed when a new one has to
+            // be opened over the limit, and appended to if that language shows up again
+            // with shards > 1, records go to lang/<shard>/ (or to one tsv file per shard) by a stable hash of their url or host
+            // with rotation, files are written in numbered parts (text.0.gz, text.1.gz...), each one renamed from a temporary
+            // name when it is finished; a language whose files are closed to stay under max_open_languages starts a new part
+            explicit BilangWriter(const std::string& folder, const std::unordered_set<std::string>& output_files,
+                                  const CompressionOptions& compression = CompressionOptions(), TextFormat format = TextFormat::BASE64,
+                                  std::size_t max_open_languages = 0, std::size_t shards = 1, ShardKey shard_key = ShardKey::URL,
+                                  const RotationOptions& rotation = RotationOptions(),
+                                  const std::vector<std::string>& tsv_columns = DEFAULT_TSV_COLUMNS) :
                 folder(folder),
-                tsv_writer(),
+                pool(compression.threads > 0 ? new util::ThreadPool(compression.threads) : nullptr),
+                compression(compression),
+                tsv_files(),
                 url_files(),
                 mime_files(),
                 text_files(),
                 html_files(),
-                output_files(output_files)
+                output_files(output_files),
+                format(format),
+                shards(shards),
+                shard_key(shard_key),
+                rotation(rotation),
+                folder_parts(),
+                folder_records(),
+                tsv_parts(),
+                tsv_records(),
+                tsv_columns(tsv_columns),
+                max_open_languages(max_open_languages),
+                open_folders(),
+                open_folder_positions(),
+                created_folders()
             {};
 
             void write(const Record& record, bool multilang = false, bool paragraph_identification = false);
             void write_tsv(const Record& record);
+            // close all files, throws WriteError on the first one that fails
+            void close();
     };
 
 
@@ -0,0 +1,63 @@
+#include "boilerplate.hh"
+#include "util.hh"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+namespace warc2text {
+
+    BoilerplateFilter::BoilerplateFilter(std::size_t threshold, std::size_t width, std::size_t depth) :
+        threshold(threshold),
+        width(width),
+        depth(depth),
+        counters(width * depth, 0) {}
+
+    uint32_t BoilerplateFilter::increment(uint64_t hash) {
+        // the counters of each row are picked by combining the two halves of the hash
+        uint64_t h1 = hash & 0xffffffff;
+        uint64_t h2 = hash >> 32;
+        uint32_t minimum = std::numeric_limits<uint32_t>::max();
+        for (std::size_t row = 0; row < depth; ++row)
+            minimum = std::min(minimum, counters[row * width + (h1 + row * h2) % width]);
+        if (minimum == std::numeric_limits<uint32_t>::max())
+            return minimum;
+        for (std::size_t row = 0; row < depth; ++row) {
+            uint32_t& counter = counters[row * width + (h1 + row * h2) % width];
+            if (counter == minimum)
+                ++counter;
+        }
+        return minimum + 1;
+    }
+
+    std::size_t BoilerplateFilter::filter(const std::string& host, std::string& text) {
+        uint64_t host_hash = util::hashBytes(host);
+        // paragraphs are counted once per document, repetitions within it share the decision of the first one
+        std::unordered_map<uint64_t, bool> document;
+        std::string kept;
+        kept.reserve(text.size());
+
+        std::size_t start = 0;
+        while (start < text.size()) {
+            std::size_t end = std::min(text.find('\n', start), text.size());
+            std::size_t next = std::min(end + 1, text.size());
+            bool keep = true;
+            if (end > start) {
+                uint64_t hash = util::hashBytes(text.data() + start, end - start, host_hash);
+                auto decision = document.find(hash);
+                if (decision == document.end())
+                    decision = document.emplace(hash, increment(hash) <= threshold).first;
+                keep = decision->second;
+            }
+            if (keep)
+                kept.append(text, start, next - start);
+            start = next;
+        }
+        // without a final line break, removing the last paragraph leaves one
+        if (not text.empty() and text.back() != '\n' and not kept.empty() and kept.back() == '\n')
+            kept.pop_back();
+
+        std::size_t removed = text.size() - kept.size();
+        text.swap(kept);
+        return removed;
+    }
+}
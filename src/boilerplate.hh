@@ -0,0 +1,33 @@
+#ifndef WARC2TEXT_BOILERPLATE_HH
+#define WARC2TEXT_BOILERPLATE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace warc2text {
+
+    // removes paragraphs (lines) that repeat across the documents of a host, like menus, cookie banners and footers
+    // the number of documents of each host with each paragraph is counted in a count-min sketch of bounded size,
+    // which can only overestimate counts, and paragraphs are removed once they have been seen in more than
+    // threshold documents of the host, so the first documents of a host keep them
+    class BoilerplateFilter {
+        public:
+            explicit BoilerplateFilter(std::size_t threshold, std::size_t width = 1 << 20, std::size_t depth = 4);
+
+            // counts the paragraphs of text, a document of host, and removes the frequent ones
+            // returns the number of bytes removed
+            std::size_t filter(const std::string& host, std::string& text);
+
+        private:
+            std::size_t threshold;
+            std::size_t width;
+            std::size_t depth;
+            std::vector<uint32_t> counters;
+
+            // increments the counters of a paragraph that are at its minimum (conservative update), returning the new count
+            uint32_t increment(uint64_t hash);
+    };
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "compressor.hh"
+#include "zlib.h"
+#include <algorithm>
+#include <vector>
+#include <boost/algorithm/string/split.hpp>
+#ifdef WITH_ZSTD
+#include <zstd.h>
+#endif
+#ifdef WITH_LZ4
+#include <lz4frame.h>
+#endif
+
+namespace warc2text {
+
+    constexpr int Codec::DEFAULT_LEVEL;
+
+    std::string Codec::extension() const {
+        switch (type) {
+            case CodecType::GZIP: return ".gz";
+            case CodecType::ZSTD: return ".zst";
+            case CodecType::LZ4: return ".lz4";
+            default: return "";
+        }
+    }
+
+    const Codec& CompressionOptions::get(const std::string& output) const {
+        auto it = codecs.find(output);
+        return it == codecs.end() ? default_codec : it->second;
+    }
+
+    Codec parseCodec(const std::string& spec) {
+        std::size_t colon = spec.find(':');
+        std::string name = spec.substr(0, colon);
+        int level = Codec::DEFAULT_LEVEL;
+        if (colon != std::string::npos) {
+            try {
+                level = std::stoi(spec.substr(colon + 1));
+            } catch (const std::logic_error&) {
+                throw std::invalid_argument("invalid compression level in '" + spec + "'");
+            }
+        }
+
+        if (name == "gzip") return Codec(CodecType::GZIP, level);
+        if (name == "none") return Codec(CodecType::NONE, level);
+        if (name == "zstd") {
+#ifdef WITH_ZSTD
+            return Codec(CodecType::ZSTD, level);
+#else
+            throw std::invalid_argument("warc2text was built without zstd support");
+#endif
+        }
+        if (name == "lz4") {
+#ifdef WITH_LZ4
+            return Codec(CodecType::LZ4, level);
+#else
+            throw std::invalid_argument("warc2text was built without lz4 support");
+#endif
+        }
+        throw std::invalid_argument("unknown compression codec '" + name + "'");
+    }
+
+    void parseCompression(const std::string& spec, CompressionOptions& options) {
+        std::vector<std::string> entries;
+        boost::algorithm::split(entries, spec, [](char c) {return c == ',';});
+        for (const std::string& entry : entries) {
+            if (entry.empty()) continue;
+            std::size_t equals = entry.find('=');
+            if (equals == std::string::npos)
+                options.default_codec = parseCodec(entry);
+            else
+                options.codecs[entry.substr(0, equals)] = parseCodec(entry.substr(equals + 1));
+        }
+    }
+
+    class GzipCompressor : public Compressor {
+        public:
+            static const std::size_t BUFFER_SIZE = 4096;
+
+        private:
+            z_stream s{};
+            unsigned char buf[BUFFER_SIZE];
+
+            void deflateAll(const char* in, std::size_t size, int flush, std::string& out) {
+                s.avail_in = size;
+                s.next_in = (Bytef *) in;
+                s.avail_out = 0;
+                while (s.avail_out == 0) {
+                    s.avail_out = BUFFER_SIZE;
+                    s.next_out = buf;
+                    // Z_BUF_ERROR only means that no progress was possible, and Z_STREAM_END only happens with Z_FINISH
+                    if (deflate(&s, flush) == Z_STREAM_ERROR)
+                        throw WriteError("zlib compression error");
+                    out.append((const char*) buf, BUFFER_SIZE - s.avail_out);
+                }
+            }
+
+        public:
+            explicit GzipCompressor(int level) {
+                if (deflateInit2(&s, level == Codec::DEFAULT_LEVEL ? Z_DEFAULT_COMPRESSION : level, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                    throw WriteError("Failed to init zlib");
+            }
+
+            ~GzipCompressor() {
+                deflateEnd(&s);
+            }
+
+            void compress(const char* in, std::size_t size, std::string& out) {
+                if (size > 0) deflateAll(in, size, Z_NO_FLUSH, out);
+            }
+
+            void flush(std::string& out) {
+                deflateAll("", 0, Z_SYNC_FLUSH, out);
+            }
+
+            void finish(std::string& out) {
+                deflateAll("", 0, Z_FINISH, out);
+                deflateReset(&s);
+            }
+    };
+
+#ifdef WITH_ZSTD
+    class ZstdCompressor : public Compressor {
+        private:
+            ZSTD_CCtx* ctx;
+            std::string buf;
+
+            void compressAll(const char* in, std::size_t size, ZSTD_EndDirective mode, std::string& out) {
+                ZSTD_inBuffer input = {in, size, 0};
+                std::size_t remaining;
+                do {
+                    ZSTD_outBuffer output = {&buf[0], buf.size(), 0};
+                    remaining = ZSTD_compressStream2(ctx, &output, &input, mode);
+                    if (ZSTD_isError(remaining))
+                        throw WriteError(std::string("zstd compression error: ") + ZSTD_getErrorName(remaining));
+                    out.append(buf.data(), output.pos);
+                // with ZSTD_e_continue, it is done when all input is consumed; otherwise, when nothing remains to be flushed
+                } while (mode == ZSTD_e_continue ? input.pos < input.size : remaining != 0);
+            }
+
+        public:
+            explicit ZstdCompressor(int level) : ctx(ZSTD_createCCtx()), buf(ZSTD_CStreamOutSize(), '\0') {
+                if (!ctx)
+                    throw WriteError("Failed to init zstd");
+                if (level != Codec::DEFAULT_LEVEL)
+                    ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, level);
+            }
+
+            ~ZstdCompressor() {
+                ZSTD_freeCCtx(ctx);
+            }
+
+            void compress(const char* in, std::size_t size, std::string& out) {
+                if (size > 0) compressAll(in, size, ZSTD_e_continue, out);
+            }
+
+            void flush(std::string& out) {
+                compressAll("", 0, ZSTD_e_flush, out);
+            }
+
+            void finish(std::string& out) {
+                compressAll("", 0, ZSTD_e_end, out);
+            }
+    };
+#endif
+
+#ifdef WITH_LZ4
+    class LZ4Compressor : public Compressor {
+        private:
+            LZ4F_cctx* ctx;
+            LZ4F_preferences_t prefs;
+            bool started;
+            std::string buf;
+
+            void check(std::size_t ret) {
+                if (LZ4F_isError(ret))
+                    throw WriteError(std::string("lz4 compression error: ") + LZ4F_getErrorName(ret));
+            }
+
+            // the frame header is written lazily, so that finish() can be followed by a new frame
+            void begin(std::string& out) {
+                if (started) return;
+                std::size_t written = LZ4F_compressBegin(ctx, &buf[0], buf.size(), &prefs);
+                check(written);
+                out.append(buf.data(), written);
+                started = true;
+            }
+
+        public:
+            // input is handed to lz4 in chunks of this size, so that the output buffer has a fixed size
+            static const std::size_t CHUNK_SIZE = 65536;
+
+            explicit LZ4Compressor(int level) : ctx(nullptr), prefs(), started(false) {
+                check(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION));
+                if (level != Codec::DEFAULT_LEVEL)
+                    prefs.compressionLevel = level;
+                buf.resize(std::max<std::size_t>(LZ4F_compressBound(CHUNK_SIZE, &prefs), LZ4F_HEADER_SIZE_MAX));
+            }
+
+            ~LZ4Compressor() {
+                LZ4F_freeCompressionContext(ctx);
+            }
+
+            void compress(const char* in, std::size_t size, std::string& out) {
+                begin(out);
+                for (std::size_t pos = 0; pos < size; pos += CHUNK_SIZE) {
+                    std::size_t written = LZ4F_compressUpdate(ctx, &buf[0], buf.size(), in + pos, std::min(CHUNK_SIZE, size - pos), nullptr);
+                    check(written);
+                    out.append(buf.data(), written);
+                }
+            }
+
+            void flush(std::string& out) {
+                begin(out);
+                std::size_t written = LZ4F_flush(ctx, &buf[0], buf.size(), nullptr);
+                check(written);
+                out.append(buf.data(), written);
+            }
+
+            void finish(std::string& out) {
+                begin(out);
+                std::size_t written = LZ4F_compressEnd(ctx, &buf[0], buf.size(), nullptr);
+                check(written);
+                out.append(buf.data(), written);
+                started = false;
+            }
+    };
+#endif
+
+    class NullCompressor : public Compressor {
+        public:
+            void compress(const char* in, std::size_t size, std::string& out) {
+                out.append(in, size);
+            }
+
+            void flush(std::string&) {}
+
+            void finish(std::string&) {}
+    };
+
+    std::unique_ptr<Compressor> makeCompressor(const Codec& codec) {
+        switch (codec.type) {
+            case CodecType::GZIP: return std::unique_ptr<Compressor>(new GzipCompressor(codec.level));
+#ifdef WITH_ZSTD
+            case CodecType::ZSTD: return std::unique_ptr<Compressor>(new ZstdCompressor(codec.level));
+#endif
+#ifdef WITH_LZ4
+            case CodecType::LZ4: return std::unique_ptr<Compressor>(new LZ4Compressor(codec.level));
+#endif
+            case CodecType::NONE: return std::unique_ptr<Compressor>(new NullCompressor());
+            default: throw WriteError("compression codec not supported by this build");
+        }
+    }
+
+}
@@ -0,0 +1,64 @@
+#ifndef WARC2TEXT_COMPRESSOR_HH
+#define WARC2TEXT_COMPRESSOR_HH
+
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+namespace warc2text {
+
+    class WriteError : public std::runtime_error {
+        public:
+            explicit WriteError(const std::string& error) : std::runtime_error(error) {};
+    };
+
+    enum class CodecType { GZIP, ZSTD, LZ4, NONE };
+
+    struct Codec {
+        CodecType type;
+        int level;
+
+        static constexpr int DEFAULT_LEVEL = std::numeric_limits<int>::min();
+
+        explicit Codec(CodecType type = CodecType::GZIP, int level = DEFAULT_LEVEL) : type(type), level(level) {};
+
+        // file name extension, including the dot (empty without compression)
+        std::string extension() const;
+    };
+
+    // codec of each output ("url", "text", "mime", "html" or "tsv"), and threads to compress them in parallel blocks
+    struct CompressionOptions {
+        Codec default_codec;
+        std::unordered_map<std::string, Codec> codecs;
+        std::size_t threads;
+
+        CompressionOptions() : default_codec(), codecs(), threads(0) {};
+
+        const Codec& get(const std::string& output) const;
+    };
+
+    // parse "codec[:level]", with codec one of gzip, zstd, lz4 or none
+    // throws std::invalid_argument if the codec is unknown or warc2text was built without it
+    Codec parseCodec(const std::string& spec);
+
+    // parse a comma separated list of "[output=]codec[:level]", entries without output set the default codec
+    void parseCompression(const std::string& spec, CompressionOptions& options);
+
+    // streaming compressor, all methods append their output to out and throw WriteError on failure
+    class Compressor {
+        public:
+            virtual ~Compressor() {};
+            virtual void compress(const char* in, std::size_t size, std::string& out) = 0;
+            // make everything compressed so far decodable
+            virtual void flush(std::string& out) = 0;
+            // end the current stream (gzip member or frame), the compressor can start a new one afterwards
+            virtual void finish(std::string& out) = 0;
+    };
+
+    std::unique_ptr<Compressor> makeCompressor(const Codec& codec);
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include "domainfilter.hh"
+#include "compressor.hh"
+#include "hashset.hh"
+#include "util.hh"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+namespace warc2text {
+
+    // a table is this magic, the number of hashes as a uint64_t and the sorted hashes
+    static const char MAGIC[8] = {'w', '2', 't', 'd', 'o', 'm', 's', '1'};
+    static const std::size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint64_t);
+
+    // lowercase domain without surrounding whitespace, leading "*." or "." and trailing "."
+    static std::string normalizeDomain(const std::string& line) {
+        std::string domain = boost::algorithm::trim_copy(line);
+        if (boost::algorithm::starts_with(domain, "*."))
+            domain.erase(0, 2);
+        else if (boost::algorithm::starts_with(domain, "."))
+            domain.erase(0, 1);
+        if (boost::algorithm::ends_with(domain, "."))
+            domain.pop_back();
+        util::toLower(domain);
+        return domain;
+    }
+
+    DomainFilter::DomainFilter(const std::string& filename) :
+        memory(), fd(-1), map(nullptr), map_size(0), begin(nullptr), end(nullptr) {
+        // tables used to be hash sets
+        if (HashSet::isFile(filename))
+            throw WriteError(filename + " is an old domain table, write it again with --compile-domain-filters");
+        if (isTable(filename)) {
+            mapTable(filename);
+        } else {
+            memory = read(filename);
+            begin = memory.data();
+            end = memory.data() + memory.size();
+        }
+    }
+
+    DomainFilter::~DomainFilter() {
+        if (map) munmap(map, map_size);
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool DomainFilter::isTable(const std::string& filename) {
+        char magic[sizeof(MAGIC)];
+        std::FILE* f = std::fopen(filename.c_str(), "rb");
+        if (!f)
+            return false;
+        bool is_table = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) and std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+        std::fclose(f);
+        return is_table;
+    }
+
+    void DomainFilter::mapTable(const std::string& filename) {
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw WriteError("Could not open " + filename + ": " + std::strerror(errno));
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+            throw WriteError("Could not read " + filename + ": " + std::strerror(errno));
+        map_size = st.st_size;
+        map = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            throw WriteError("Could not map " + filename + ": " + std::strerror(errno));
+        }
+        uint64_t count = 0;
+        if (map_size >= HEADER_SIZE)
+            std::memcpy(&count, static_cast<const char*>(map) + sizeof(MAGIC), sizeof(count));
+        if (map_size < HEADER_SIZE or (map_size - HEADER_SIZE) % sizeof(uint64_t) != 0
+            or (map_size - HEADER_SIZE) / sizeof(uint64_t) != count)
+            throw WriteError(filename + " is not a warc2text domain table");
+        begin = reinterpret_cast<const uint64_t*>(static_cast<const char*>(map) + HEADER_SIZE);
+        end = begin + count;
+    }
+
+    std::vector<uint64_t> DomainFilter::read(const std::string& list) {
+        std::ifstream f(list);
+        if (!f)
+            throw WriteError("Could not open " + list);
+        std::vector<uint64_t> hashes;
+        std::string line;
+        while (std::getline(f, line)) {
+            std::string domain = normalizeDomain(line);
+            if (!domain.empty() and domain[0] != '#')
+                hashes.push_back(util::hashBytes(domain));
+        }
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+        return hashes;
+    }
+
+    void DomainFilter::compile(const std::string& list, const std::string& table) {
+        std::vector<uint64_t> hashes = read(list);
+        uint64_t count = hashes.size();
+        // written next to the table and renamed, so that a running warc2text never maps half a table
+        std::string tmp = table + ".tmp";
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f)
+            throw WriteError("Could not open " + tmp + ": " + std::strerror(errno));
+        bool ok = std::fwrite(MAGIC, sizeof(MAGIC), 1, f) == 1
+            and std::fwrite(&count, sizeof(count), 1, f) == 1
+            and std::fwrite(hashes.data(), sizeof(uint64_t), hashes.size(), f) == hashes.size();
+        if (std::fclose(f) != 0 or not ok)
+            throw WriteError("Could not write " + tmp + ": " + std::strerror(errno));
+        if (std::rename(tmp.c_str(), table.c_str()) != 0)
+            throw WriteError("Could not rename " + tmp + ": " + std::strerror(errno));
+    }
+
+    bool DomainFilter::blocked(const std::string& host) const {
+        std::size_t size = host.size();
+        if (size > 0 and host[size - 1] == '.')
+            --size;
+        // the host itself, and then every suffix after a dot
+        for (std::size_t start = 0; start < size; ++start) {
+            if (std::binary_search(begin, end, util::hashBytes(host.data() + start, size - start)))
+                return true;
+            start = host.find('.', start);
+            if (start >= size)
+                break;
+        }
+        return false;
+    }
+
+    std::size_t DomainFilter::size() const {
+        return end - begin;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef WARC2TEXT_DOMAINFILTER_HH
+#define WARC2TEXT_DOMAINFILTER_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace warc2text {
+
+    // set of blocked domains, which also block all their subdomains
+    // domains are kept as a sorted array of 64-bit hashes, 8 bytes each, so a host is looked up with one
+    // binary search per parent domain
+    class DomainFilter {
+        public:
+            // filename is either a list of domains, one per line (lines beginning with # and empty lines are
+            // ignored), or a table written by compile, which is memory-mapped instead of read
+            // throws WriteError if the file can not be read
+            explicit DomainFilter(const std::string& filename);
+            ~DomainFilter();
+            DomainFilter(const DomainFilter&) = delete;
+            DomainFilter& operator=(const DomainFilter&) = delete;
+
+            // writes the domains of list as a table, throws WriteError if it fails
+            static void compile(const std::string& list, const std::string& table);
+
+            // true if host or any of its parent domains is blocked
+            bool blocked(const std::string& host) const;
+            std::size_t size() const;
+
+        private:
+            // hashes read from a list, or the mapped table
+            std::vector<uint64_t> memory;
+            int fd;
+            void* map;
+            std::size_t map_size;
+            const uint64_t* begin;
+            const uint64_t* end;
+
+            // sorted hashes of the domains of list, without repetitions
+            static std::vector<uint64_t> read(const std::string& list);
+            static bool isTable(const std::string& filename);
+            void mapTable(const std::string& filename);
+    };
+}
+
+#endif
@@ -5,99 +5,30 @@
 #include "entities.hh"
 
 #include <string>
-#include <algorithm>
-#include <stdexcept>
+#include <cctype>
 
 #define UNICODE_MAX 0x10FFFFul
 
 namespace entities {
 
-    // pos is the index of '&'
-    // return value is the index of ';', or the index of the first invalid character
-    // return value will be std::string::npos if the entity ends without ';' at the end
-    std::size_t findEntityEnd(const std::string& source, std::size_t pos) {
-        bool numeric = false;
-        bool hex = false;
-        ++pos;
-        if (pos >= source.size()) return std::string::npos;
-        if (source[pos] == '#') {
-            numeric = true;
-            ++pos;
+    void decodeEntity(const std::string& body, std::string& target) {
+        if (body.empty() or body[0] != '#') {
+            auto it = named_entities.find(body);
+            if (it != named_entities.cend())
+                target.append(it->second);
+            return;
         }
-        if (pos >= source.size()) return std::string::npos;
-        if (source[pos] == 'x' or source[pos] == 'X') {
-            hex = true;
-            ++pos;
+        bool hex = body.size() > 1 and (body[1] == 'x' or body[1] == 'X');
+        std::size_t pos = hex ? 2 : 1;
+        if (pos >= body.size()) return;
+        unsigned long entity_code = 0;
+        for (; pos < body.size(); ++pos) {
+            int digit = std::isdigit(body[pos]) ? body[pos] - '0' : std::tolower(body[pos]) - 'a' + 10;
+            entity_code = entity_code * (hex ? 16 : 10) + digit;
+            // stop before the value can overflow, it is not a valid code point anyway
+            if (entity_code > UNICODE_MAX) return;
         }
-        // actual entity:
-        bool digit;
-        bool xdigit;
-        bool alpha;
-        for (; pos < source.size(); ++pos) {
-            if (source[pos] == ';') return pos;
-            digit = std::isdigit(source[pos]);
-            alpha = std::isalpha(source[pos]);
-            xdigit = std::isxdigit(source[pos]);
-            // decimal entities must only have digits
-            if (numeric and not hex and alpha) return pos;
-            // hex entities must only have xdigits
-            if (hex and not xdigit) return pos;
-            // entities may only contains digits and alpha chars
-            if (not alpha and not digit) return pos;
-        }
-        return std::string::npos;
-    }
-
-    void decodeEntities(const std::string& source, std::string& target) {
-        std::size_t pos = source.find('&');
-        std::size_t end_pos = 0;
-        std::size_t len;
-        auto* tail = new std::size_t;
-        std::size_t entity_code;
-        bool hex;
-
-        target.clear();
-        target.reserve(source.size());
-        std::unordered_map<std::string, std::string>::const_iterator it;
-        while (pos != std::string::npos) {
-            target.append(source, end_pos, pos-end_pos); // append everthing before '&'
-            end_pos = findEntityEnd(source, pos); // find where the entity ends
-            if (end_pos == std::string::npos) {
-                // entity has no proper ending, append the rest of the string and quit
-                target.append(source, pos);
-                break;
-            }
-            else if (source[end_pos] != ';') {
-                // invalid char found: '&' didn't start a proper entity
-                // append the the consumed chars
-                target.append(source, pos, end_pos-pos);
-            } else if (source[pos+1] == '#') { // proper numeric entity
-                hex = ((pos+2 < end_pos) and (source[pos+2] == 'x' or source[pos+2] == 'X'));
-                len = end_pos - pos - (hex ? 3 : 2);
-                pos = pos + (hex ? 3 : 2);
-		try{
-	                entity_code = std::stoul(source.substr(pos, len), tail, hex ? 16 : 10);
-	                if (*tail == len and entity_code <= UNICODE_MAX)
-	                    target.append(get_dec_entity(entity_code));
-	                ++end_pos;
-		} catch (std::invalid_argument const& ex){
-			// invalid numeric entity code
-			// append the the consumed chars
-			target.append(source, pos, end_pos-pos);
-		}
-            }
-            else { // proper named entity
-                it = named_entities.find(source.substr(pos+1, end_pos-pos-1));
-                if (it != named_entities.cend())
-                    target.append(it->second);
-                ++end_pos;
-            }
-            // find where the next entity starts
-            pos = source.find('&', end_pos);
-        }
-        // append the rest of the string
-        target.append(source, end_pos, pos-end_pos);
-        delete tail;
+        target.append(get_dec_entity(entity_code));
     }
 
     // &npsp; &thinsp; etc are treated as normal spaces
@@ -10,7 +10,9 @@
 #include <string>
 
 namespace entities {
-    void decodeEntities(const std::string& source, std::string& target);
+    // decode a single entity given its body (what is between '&' and ';') and append it to target
+    // unknown named entities and invalid code points are dropped
+    void decodeEntity(const std::string& body, std::string& target);
     std::string get_dec_entity(unsigned long cp);
 
     extern std::unordered_map<std::string, std::string> named_entities;
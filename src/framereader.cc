@@ -0,0 +1,52 @@
+#include "framereader.hh"
+
+namespace warc2text {
+
+    bool FrameReader::readLength(std::size_t& length) {
+        length = 0;
+        for (unsigned int shift = 0; ; shift += 7) {
+            int c = in.get();
+            if (c == std::char_traits<char>::eof()) {
+                if (shift == 0) return false;
+                throw FrameError("Truncated chunk length in frame " + std::to_string(frames));
+            }
+            if (shift >= 8 * sizeof(std::size_t))
+                throw FrameError("Invalid chunk length in frame " + std::to_string(frames));
+            length |= static_cast<std::size_t>(c & 0x7f) << shift;
+            if (!(c & 0x80)) return true;
+        }
+    }
+
+    bool FrameReader::next(std::string& frame) {
+        frame.clear();
+        std::size_t length;
+        if (!readLength(length)) return false;
+        while (length > 0) {
+            std::size_t offset = frame.size();
+            frame.resize(offset + length);
+            if (!in.read(&frame[offset], length))
+                throw FrameError("Truncated chunk in frame " + std::to_string(frames));
+            if (!readLength(length))
+                throw FrameError("Missing end of frame " + std::to_string(frames));
+        }
+        ++frames;
+        return true;
+    }
+
+    bool readTSVDocument(FrameReader& reader, TSVDocument& document, const std::vector<std::string>& columns) {
+        std::string frame;
+        if (!reader.next(frame)) return false;
+        document.metadata.clear();
+        std::size_t start = 0;
+        for (std::size_t i = 0; i + 1 < columns.size(); ++i) {
+            std::size_t tab = frame.find('\t', start);
+            if (tab == std::string::npos)
+                throw FrameError("Missing metadata columns in tsv frame");
+            document.metadata[columns[i]].assign(frame, start, tab - start);
+            start = tab + 1;
+        }
+        document.text.assign(frame, start, std::string::npos);
+        return true;
+    }
+
+}
@@ -0,0 +1,56 @@
+#ifndef WARC2TEXT_FRAMEREADER_HH
+#define WARC2TEXT_FRAMEREADER_HH
+
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// reader for the output written with --text-format framed
+//
+// every document is a frame of raw UTF-8: a sequence of chunks, each one its length as an unsigned
+// LEB128 number followed by that many bytes, ended by an empty chunk (a single zero byte)
+// text and html files hold one frame per line of the url file; tsv output holds one frame per document
+// with the metadata columns of --tsv-columns (lang, date, digest and url by default), each followed by a tab,
+// before the text or html
+//
+// the reader works on decompressed input, e.g. a boost::iostreams::filtering_istream with a gzip_decompressor
+
+namespace warc2text {
+
+    class FrameError : public std::runtime_error {
+        public:
+            explicit FrameError(const std::string& error) : std::runtime_error(error) {};
+    };
+
+    class FrameReader {
+        private:
+            std::istream& in;
+            std::size_t frames;
+            // returns false if the input ends before the first byte
+            bool readLength(std::size_t& length);
+
+        public:
+            explicit FrameReader(std::istream& in) : in(in), frames(0) {};
+            // read the next frame into frame, returns false at the end of the input
+            // throws FrameError if the input ends in the middle of a frame or is not framed output
+            bool next(std::string& frame);
+    };
+
+    struct TSVDocument {
+        // metadata columns by name, e.g. "lang" or "url"
+        std::unordered_map<std::string, std::string> metadata;
+        // the last column, text or html
+        std::string text;
+    };
+
+    // read the next document of framed tsv output, returns false at the end of the input
+    // columns are the --tsv-columns the output was written with, the last one being the document
+    // throws FrameError if the frame has fewer metadata columns
+    bool readTSVDocument(FrameReader& reader, TSVDocument& document,
+                         const std::vector<std::string>& columns = {"lang", "date", "digest", "url", "text"});
+
+}
+
+#endif
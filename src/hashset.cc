@@ -0,0 +1,164 @@
+#include "hashset.hh"
+#include "compressor.hh"
+#include "util.hh"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace warc2text {
+
+    Hash128 hash128(const char* data, std::size_t size) {
+        Hash128 hash = {util::hashBytes(data, size, 0), util::hashBytes(data, size, 0x9e3779b97f4a7c15ULL)};
+        // all zeros marks empty slots
+        if (hash.low == 0 and hash.high == 0)
+            hash.high = 1;
+        return hash;
+    }
+
+    static const char MAGIC[8] = {'w', '2', 't', 'h', 's', 'e', 't', '1'};
+
+    static bool empty(const Hash128& slot) {
+        return slot.low == 0 and slot.high == 0;
+    }
+
+    // index of hash, or of the empty slot where it would go
+    static std::size_t probe(const Hash128* slots, uint64_t capacity, const Hash128& hash) {
+        std::size_t i = hash.low & (capacity - 1);
+        while (not empty(slots[i]) and (slots[i].low != hash.low or slots[i].high != hash.high))
+            i = (i + 1) & (capacity - 1);
+        return i;
+    }
+
+    static std::size_t roundCapacity(std::size_t capacity) {
+        std::size_t rounded = 16;
+        while (rounded < capacity)
+            rounded <<= 1;
+        return rounded;
+    }
+
+    HashSet::HashSet(std::size_t capacity) :
+        filename(), fd(-1), map(nullptr), map_size(0), header(nullptr), slots(nullptr), memory() {
+        allocate(roundCapacity(capacity));
+    }
+
+    HashSet::HashSet(const std::string& filename, std::size_t capacity, bool read_only) :
+        filename(filename), fd(-1), map(nullptr), map_size(0), header(nullptr), slots(nullptr), memory() {
+        struct stat st;
+        bool exists = read_only or (stat(filename.c_str(), &st) == 0 and st.st_size > 0);
+        mapFile(filename, exists ? 0 : roundCapacity(capacity), not exists, read_only);
+    }
+
+    bool HashSet::isFile(const std::string& filename) {
+        char magic[sizeof(MAGIC)];
+        std::FILE* f = std::fopen(filename.c_str(), "rb");
+        if (!f)
+            return false;
+        bool is_file = std::fread(magic, 1, sizeof(magic), f) == sizeof(magic) and std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+        std::fclose(f);
+        return is_file;
+    }
+
+    HashSet::~HashSet() {
+        unmap();
+    }
+
+    void HashSet::allocate(std::size_t capacity) {
+        memory.assign(sizeof(Header) + capacity * sizeof(Hash128), 0);
+        header = reinterpret_cast<Header*>(memory.data());
+        std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+        header->capacity = capacity;
+        header->size = 0;
+        slots = reinterpret_cast<Hash128*>(memory.data() + sizeof(Header));
+    }
+
+    // with create, path is truncated to an empty set of capacity slots, otherwise an existing set is opened
+    void HashSet::mapFile(const std::string& path, std::size_t capacity, bool create, bool read_only) {
+        fd = open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : read_only ? O_RDONLY : O_RDWR, 0644);
+        if (fd < 0)
+            throw WriteError("Could not open " + path + ": " + std::strerror(errno));
+        if (create) {
+            map_size = sizeof(Header) + capacity * sizeof(Hash128);
+            if (ftruncate(fd, map_size) != 0)
+                throw WriteError("Could not resize " + path + ": " + std::strerror(errno));
+        } else {
+            struct stat st;
+            if (fstat(fd, &st) != 0)
+                throw WriteError("Could not read " + path + ": " + std::strerror(errno));
+            map_size = st.st_size;
+        }
+        map = mmap(nullptr, map_size, read_only ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            map = nullptr;
+            throw WriteError("Could not map " + path + ": " + std::strerror(errno));
+        }
+        header = static_cast<Header*>(map);
+        slots = reinterpret_cast<Hash128*>(static_cast<char*>(map) + sizeof(Header));
+        if (create) {
+            std::memcpy(header->magic, MAGIC, sizeof(MAGIC));
+            header->capacity = capacity;
+            header->size = 0;
+        } else if (map_size < sizeof(Header) or std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0
+                   or map_size != sizeof(Header) + header->capacity * sizeof(Hash128)) {
+            throw WriteError(path + " is not a warc2text hash set");
+        }
+    }
+
+    void HashSet::unmap() {
+        if (map) munmap(map, map_size);
+        if (fd >= 0) ::close(fd);
+        map = nullptr;
+        fd = -1;
+    }
+
+    bool HashSet::insert(const Hash128& hash) {
+        std::size_t i = probe(slots, header->capacity, hash);
+        if (not empty(slots[i]))
+            return false;
+        slots[i] = hash;
+        if (++header->size * 2 > header->capacity)
+            grow();
+        return true;
+    }
+
+    bool HashSet::contains(const Hash128& hash) const {
+        return not empty(slots[probe(slots, header->capacity, hash)]);
+    }
+
+    std::size_t HashSet::size() const {
+        return header->size;
+    }
+
+    // rehash into a table twice as large, a file one is built next to the old one and renamed over it
+    void HashSet::grow() {
+        uint64_t capacity = header->capacity * 2;
+        uint64_t size = header->size;
+        std::vector<unsigned char> old_memory;
+        void* old_map = map;
+        std::size_t old_map_size = map_size;
+        int old_fd = fd;
+        const Hash128* old_slots = slots;
+        uint64_t old_capacity = header->capacity;
+
+        if (filename.empty()) {
+            old_memory.swap(memory);
+            allocate(capacity);
+        } else {
+            mapFile(filename + ".tmp", capacity, true);
+        }
+        for (std::size_t i = 0; i < old_capacity; ++i)
+            if (not empty(old_slots[i]))
+                slots[probe(slots, capacity, old_slots[i])] = old_slots[i];
+        header->size = size;
+
+        if (not filename.empty()) {
+            munmap(old_map, old_map_size);
+            ::close(old_fd);
+            if (std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0)
+                throw WriteError("Could not rename " + filename + ".tmp: " + std::strerror(errno));
+        }
+    }
+}
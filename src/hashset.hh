@@ -0,0 +1,61 @@
+#ifndef WARC2TEXT_HASHSET_HH
+#define WARC2TEXT_HASHSET_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace warc2text {
+
+    struct Hash128 {
+        uint64_t low;
+        uint64_t high;
+    };
+
+    // two MurmurHash64A with different seeds, never all zeros
+    Hash128 hash128(const char* data, std::size_t size);
+    inline Hash128 hash128(const std::string& data) { return hash128(data.data(), data.size()); }
+
+    // set of 128-bit hashes, open addressing with linear probing, kept at most half full
+    // it lives in memory, or in a memory-mapped file so that it persists across runs
+    // throws WriteError if the file can not be created, read or grown
+    // a read only set is opened from an existing file and can not be inserted into
+    class HashSet {
+        public:
+            explicit HashSet(std::size_t capacity = 1 << 16);
+            explicit HashSet(const std::string& filename, std::size_t capacity = 1 << 20, bool read_only = false);
+            ~HashSet();
+            HashSet(const HashSet&) = delete;
+            HashSet& operator=(const HashSet&) = delete;
+
+            // false if hash was already in the set
+            bool insert(const Hash128& hash);
+            bool contains(const Hash128& hash) const;
+            std::size_t size() const;
+
+            // true if filename starts like a hash set file
+            static bool isFile(const std::string& filename);
+
+        private:
+            struct Header {
+                char magic[8];
+                uint64_t capacity;
+                uint64_t size;
+            };
+
+            std::string filename;
+            int fd;
+            void* map;
+            std::size_t map_size;
+            Header* header;
+            Hash128* slots;
+            std::vector<unsigned char> memory;
+
+            void allocate(std::size_t capacity);
+            void mapFile(const std::string& path, std::size_t capacity, bool create, bool read_only = false);
+            void unmap();
+            void grow();
+    };
+}
+
+#endif
@@ -1,70 +1,100 @@
 #include "src/lang.hh"
+#include <algorithm>
 
 namespace warc2text {
     // hint = {content language code(s), tld, original encoding, CLD2::Language}
     const CLD2::CLDHints NO_HINT = {nullptr, nullptr, CLD2::UNKNOWN_ENCODING, CLD2::UNKNOWN_LANGUAGE};
 
-    bool detectLanguage(const std::string& text, std::unordered_map<std::string, std::string>& text_by_lang){
+    bool detectLanguage(const std::string& text, LanguageDetection& result, bool multilang){
         CLD2::Language langs[3] = {CLD2::UNKNOWN_LANGUAGE, CLD2::UNKNOWN_LANGUAGE, CLD2::UNKNOWN_LANGUAGE};
-        int percents[3] = {0,0,0};
-        double scores[3] = {0.0, 0.0, 0.0};
-
-        bool reliable = false;
         int text_bytes;
         int valid_prefix_bytes;
 
         CLD2::ResultChunkVector chunks;
 
-        CLD2::ExtDetectLanguageSummaryCheckUTF8(text.data(), text.size(), true, &NO_HINT, 0, &langs[0], &percents[0], &scores[0], &chunks, &text_bytes, &reliable, &valid_prefix_bytes);
-
-        text_by_lang.clear();
+        result = LanguageDetection();
+        CLD2::Language top = CLD2::ExtDetectLanguageSummaryCheckUTF8(text.data(), text.size(), true, &NO_HINT, 0, &langs[0], &result.percents[0], &result.scores[0],
+                                                                     multilang ? &chunks : nullptr, &text_bytes, &result.reliable, &valid_prefix_bytes);
 
-        if (not reliable) return reliable;
+        result.language = CLD2::LanguageCode(top);
+        bool keep[3];
+        for (int i = 0; i < 3; ++i) {
+            keep[i] = langs[i] != CLD2::UNKNOWN_LANGUAGE and result.percents[i] > 0;
+            if (keep[i]) result.languages[i] = CLD2::LanguageCode(langs[i]);
+        }
 
-        std::string* top1 = nullptr;
-        std::string* top2 = nullptr;
-        std::string* top3 = nullptr;
+        if (not multilang or not result.reliable) return result.reliable;
 
-        if (langs[0] != CLD2::UNKNOWN_LANGUAGE and percents[0] > 0) {
-            top1 = &text_by_lang[CLD2::LanguageCode(langs[0])];
-            top1->reserve(text.size() * (percents[0] + 1));
+        // apparently it is possible that the reported percentage is > 0, but the language does not appear in chunks,
+        // so only languages that actually have text end up in spans
+        std::vector<LanguageSpan>& spans = result.spans;
+        for (const CLD2::ResultChunk& chunk : chunks) {
+            CLD2::Language lang = static_cast<CLD2::Language>(chunk.lang1);
+            int i = lang == langs[0] ? 0 : lang == langs[1] ? 1 : lang == langs[2] ? 2 : -1;
+            if (i == -1 or not keep[i]) continue;
+            if (static_cast<std::size_t>(chunk.offset) >= text.size() or chunk.bytes <= 0) continue;
+            std::size_t length = std::min(static_cast<std::size_t>(chunk.bytes), text.size() - chunk.offset);
+            // merge consecutive chunks of the same language
+            if (!spans.empty() and spans.back().lang == result.languages[i] and spans.back().offset + spans.back().length == static_cast<std::size_t>(chunk.offset))
+                spans.back().length += length;
+            else
+                spans.push_back({result.languages[i], static_cast<std::size_t>(chunk.offset), length});
         }
 
-        if (langs[1] != CLD2::UNKNOWN_LANGUAGE and percents[1] > 0) {
-            top2 = &text_by_lang[CLD2::LanguageCode(langs[1])];
-            top2->reserve(text.size() * (percents[1] + 1));
-        }
+        return result.reliable;
+    }
 
-        if (langs[2] != CLD2::UNKNOWN_LANGUAGE and percents[2] > 0) {
-            top3 = &text_by_lang[CLD2::LanguageCode(langs[2])];
-            top3->reserve(text.size() * (percents[2] + 1));
+    bool detectLanguage(const std::string& text, LanguageDetection& result, bool multilang, std::size_t sample_bytes){
+        if (sample_bytes == 0 or text.size() <= sample_bytes)
+            return detectLanguage(text, result, multilang);
+
+        std::string sample;
+        sampleText(text, sample_bytes, sample);
+        detectLanguage(sample, result, false);
+        if (result.reliable and result.percents[0] >= SAMPLE_MIN_PERCENT) {
+            if (multilang) result.spans = {{result.language, 0, text.size()}};
+            result.sampled = true;
+            return result.reliable;
         }
 
-        for (const CLD2::ResultChunk& chunk : chunks) {
-            std::string* ref = static_cast<CLD2::Language>(chunk.lang1) == langs[0] ? top1 :
-                        static_cast<CLD2::Language>(chunk.lang1) == langs[1] ? top2 :
-                        static_cast<CLD2::Language>(chunk.lang1) == langs[2] ? top3 : nullptr;
-            if (ref == nullptr) continue;
-            ref->append(text, chunk.offset, chunk.bytes);
-        }
+        return detectLanguage(text, result, multilang);
+    }
 
-        // remove empty texts from text_by_lang
-        // apparently it is possible that the reported percentage is > 0, but the language does not appear in chunks
-        for (auto it = text_by_lang.cbegin(); it != text_by_lang.cend(); ){
-            if (it->second.size() == 0) text_by_lang.erase(it++);
-            else ++it;
-        }
+    // move pos back until it is not in the middle of a UTF-8 character
+    std::size_t utf8Boundary(const std::string& text, std::size_t pos) {
+        while (pos > 0 and pos < text.size() and (static_cast<unsigned char>(text[pos]) & 0xC0) == 0x80)
+            --pos;
+        return pos;
+    }
 
-        // TODO: do something with the scores?
+    void sampleText(const std::string& text, std::size_t sample_bytes, std::string& sample){
+        sample.clear();
+        if (text.size() <= sample_bytes) {
+            sample = text;
+            return;
+        }
+        std::size_t window = sample_bytes / 3;
+        std::size_t starts[3] = {0, (text.size() - window) / 2, text.size() - window};
+        sample.reserve(sample_bytes + 2);
+        for (std::size_t start : starts) {
+            std::size_t begin = utf8Boundary(text, start);
+            std::size_t end = utf8Boundary(text, start + window);
+            if (!sample.empty()) sample.push_back('\n');
+            sample.append(text, begin, end - begin);
+        }
+    }
 
-        return reliable;
+    bool languageAllowed(const std::string& lang, const std::unordered_set<std::string>& allowed, const std::unordered_set<std::string>& rejected) {
+        return (allowed.empty() or allowed.count(lang) == 1) and rejected.count(lang) == 0;
     }
 
-    bool detectLanguage(const std::string& text, std::string& lang){
-        bool reliable = false;
-        int valid_prefix_bytes = 0;
-        CLD2::Language l = CLD2::DetectLanguageCheckUTF8(text.data(), text.size(), true, &reliable, &valid_prefix_bytes);
-        lang = CLD2::LanguageCode(l);
-        return reliable;
+    std::vector<std::string> spanLanguages(const std::vector<LanguageSpan>& spans) {
+        // there are at most 3 languages, so a linear search is enough
+        std::vector<std::string> langs;
+        for (const LanguageSpan& span : spans)
+            if (std::find(langs.begin(), langs.end(), span.lang) == langs.end())
+                langs.push_back(span.lang);
+        return langs;
     }
+
 } // namespace warc2text
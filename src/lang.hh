@@ -2,17 +2,53 @@
 #define WARC2TEXT_LANG_HH
 
 #include <string>
-#include <unordered_map>
+#include <vector>
+#include <unordered_set>
 #include <utility>
 #include "cld2/public/compact_lang_det.h"
 #include "cld2/public/encodings.h"
 
 namespace warc2text {
-    // detect language of plain text, return top 3 languages
-    bool detectLanguage(const std::string& text, std::unordered_map<std::string, std::string>& chunks);
+    // a range of the plain text written in a single language
+    struct LanguageSpan {
+        std::string lang;
+        std::size_t offset;
+        std::size_t length;
+    };
 
-    // detect top language of plain text
-    bool detectLanguage(const std::string& text, std::string& lang);
+    // result of language identification of a document, computed once and shared by writers and filters
+    struct LanguageDetection {
+        std::string language; // top language, set even if the detection is not reliable
+        bool reliable;
+        std::string languages[3]; // top 3 languages, empty if unknown
+        int percents[3];
+        double scores[3];
+        std::vector<LanguageSpan> spans; // only with multilang: spans of the top 3 languages in document order
+        bool sampled; // detected on a sample, without falling back to the whole text
+
+        LanguageDetection() : language(), reliable(false), languages(), percents{0, 0, 0}, scores{0.0, 0.0, 0.0}, spans(), sampled(false) {};
+    };
+
+    // detect the languages of plain text, also splitting it in spans per language if multilang is set
+    bool detectLanguage(const std::string& text, LanguageDetection& result, bool multilang);
+
+    // minimum percentage of the top language for a sample detection to be trusted
+    const int SAMPLE_MIN_PERCENT = 90;
+
+    // detect the languages of plain text looking at sample_bytes of it (head, middle and tail windows),
+    // and fall back to the whole text if the result on the sample is not reliable or mixed
+    // with multilang, a conclusive sample results in a single span covering the whole text
+    bool detectLanguage(const std::string& text, LanguageDetection& result, bool multilang, std::size_t sample_bytes);
+
+    // fill sample with three windows (head, middle and tail) of text that add up to at most sample_bytes,
+    // cut at UTF-8 character boundaries and separated by newlines
+    void sampleText(const std::string& text, std::size_t sample_bytes, std::string& sample);
+
+    // true if lang is in allowed (or allowed is empty) and not in rejected
+    bool languageAllowed(const std::string& lang, const std::unordered_set<std::string>& allowed, const std::unordered_set<std::string>& rejected);
+
+    // distinct languages of spans, in order of first appearance
+    std::vector<std::string> spanLanguages(const std::vector<LanguageSpan>& spans);
 }
 
 #endif
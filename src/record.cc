@@ -4,9 +4,11 @@
 
 #include "record.hh"
 #include "html.hh"
+#include "simhash.hh"
 #include "util.hh"
-#include "entities.hh"
 #include "zipreader.hh"
+#include <algorithm>
+#include <cstdlib>
 #include <boost/log/trivial.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -77,6 +79,10 @@ namespace warc2text {
             pos = content.find("HTTP/1.", last_pos);
             if (pos == last_pos) { // found HTTP header
                 pos = content.find("\r\n", last_pos);
+                // status line: "HTTP/1.1 200 OK"
+                std::size_t space = content.find(' ', last_pos);
+                if (space < pos)
+                    HTTPstatus = std::atoi(content.c_str() + space + 1);
                 payload_start = read_header(content, pos + 2, HTTPheader);
                 if (payload_start == std::string::npos) {
                     // BOOST_LOG_TRIVIAL(warning) << "Response record without HTTP header";
@@ -198,7 +204,6 @@ namespace warc2text {
 
         // detect charset
         std::string detected_charset;
-        std::string extracted;
         bool detection_result = util::detectCharset(payload, detected_charset, charset);
 
         if (detection_result) charset = detected_charset;
@@ -207,37 +212,47 @@ namespace warc2text {
 
         bool needToConvert = !(charset == "utf8" or charset == "utf-8" or charset == "ascii");
         bool isPlainText = cleanHTTPcontentType == "text/plain";
-        
-        int retval = util::SUCCESS;
 
-        // remove HTML tags:
-        if (isPlainText)
-            util::trimLinesCopy(payload, extracted);
-        else
-            retval = processHTML(payload, extracted, tagFilters);
-
-        // convert to utf8 if needed:
+        // convert to utf8 if needed, before extraction so that decoded entities and text share the same encoding
+        // the original payload is kept as it is for the html output
+        std::string converted;
         if (needToConvert)
-            extracted = util::toUTF8(extracted, charset);
+            converted = util::toUTF8(payload, charset);
+        const std::string& utf8payload = needToConvert ? converted : payload;
 
-        // decode HTML entities:
+        int retval = util::SUCCESS;
+
+        // remove HTML tags (HTML entities are decoded by the tokenizer):
         if (isPlainText)
-            plaintext = extracted;
+            util::trimLinesCopy(utf8payload, plaintext);
         else
-            entities::decodeEntities(extracted, plaintext);
+            retval = processHTML(utf8payload, plaintext, tagFilters);
 
         return retval;
     }
 
-    const std::unordered_map<std::string, std::string>& Record::getTextByLangs() const {
-        return text_by_langs;
+    const std::vector<LanguageSpan>& Record::getLanguageSpans() const {
+        return lid.spans;
+    }
+
+    const LanguageDetection& Record::getLanguageDetection() const {
+        return lid;
     }
 
-    int Record::detectLanguage(bool multilang){
-        if (not multilang) return warc2text::detectLanguage(plaintext, language);
+    // returns the number of languages detected, 0 if the detection is not reliable
+    int Record::detectLanguage(bool multilang, std::size_t sample_bytes){
+        bool reliable = warc2text::detectLanguage(plaintext, lid, multilang, sample_bytes);
+        if (not multilang) return reliable;
+        return spanLanguages(lid.spans).size();
+    }
 
-        warc2text::detectLanguage(plaintext, text_by_langs);
-        return text_by_langs.size();
+    // removes the spans of unwanted languages, returns the number of languages left
+    int Record::filterLanguageSpans(const std::unordered_set<std::string>& allowed, const std::unordered_set<std::string>& rejected) {
+        std::vector<LanguageSpan>& spans = lid.spans;
+        spans.erase(std::remove_if(spans.begin(), spans.end(), [&](const LanguageSpan& span) {
+            return not languageAllowed(span.lang, allowed, rejected);
+        }), spans.end());
+        return spanLanguages(spans).size();
     }
 
     const std::string& Record::getHeaderProperty(const std::string& property) const {
@@ -271,8 +286,12 @@ namespace warc2text {
         return plaintext;
     }
 
+    int Record::getHTTPstatus() const {
+        return HTTPstatus;
+    }
+
     const std::string& Record::getLanguage() const {
-        return language;
+        return lid.language;
     }
 
     const std::string& Record::getURL() const {
@@ -303,6 +322,18 @@ namespace warc2text {
         return textContentTypes.find(cleanHTTPcontentType) != textContentTypes.end();
     }
 
+    std::size_t Record::filterBoilerplate(BoilerplateFilter& filter) {
+        return filter.filter(util::getHost(url), plaintext);
+    }
+
+    uint64_t Record::getSimHash() const {
+        return simhash;
+    }
+
+    void Record::computeSimHash() {
+        simhash = simHash(plaintext);
+    }
+
     void Record::encodeURL() {
         url = util::encodeURLs(url);
     }
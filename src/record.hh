@@ -10,6 +10,7 @@
 #include <regex>
 #include "util.hh"
 #include "lang.hh"
+#include "boilerplate.hh"
 
 namespace warc2text {
     class Record {
@@ -30,15 +31,24 @@ namespace warc2text {
         const std::string& getRecordType() const;
         const std::string& getWARCcontentType() const;
         const std::string& getHTTPcontentType() const;
+        // status code of the HTTP response, 0 without HTTP header
+        int getHTTPstatus() const;
         const std::string& getCharset() const;
         bool isBroaderDocumentFormat() const;
         bool isTextFormat() const;
 
-        const std::unordered_map<std::string, std::string>& getTextByLangs() const;
+        const std::vector<LanguageSpan>& getLanguageSpans() const;
+        const LanguageDetection& getLanguageDetection() const;
+        uint64_t getSimHash() const;
 
         int cleanPayload();
         int cleanPayload(const util::umap_tag_filters_regex& tagFilters);
-        int detectLanguage(bool multilang);
+        int detectLanguage(bool multilang, std::size_t sample_bytes = 0);
+        int filterLanguageSpans(const std::unordered_set<std::string>& allowed, const std::unordered_set<std::string>& rejected);
+        // removes the paragraphs of the plain text that are frequent on the host of the record, returns removed bytes
+        std::size_t filterBoilerplate(BoilerplateFilter& filter);
+        // SimHash of the plain text, kept in the record for the near duplicate filter and the writers
+        void computeSimHash();
 
         static std::string readZipPayload(const std::string& content_type, const std::string& payload);
         static std::string isPayloadZip(const std::string& content_type, const std::string& uri);
@@ -50,9 +60,8 @@ namespace warc2text {
         std::unordered_map<std::string, std::string> HTTPheader;
         std::string payload;
         std::string plaintext;
-        std::string language;
-
-        std::unordered_map<std::string, std::string> text_by_langs;
+        LanguageDetection lid;
+        uint64_t simhash{};
 
         // these are present in the headers, but it's convenient to have them apart also
         std::string recordType;
@@ -60,6 +69,7 @@ namespace warc2text {
         std::string cleanHTTPcontentType;
         std::string charset;
         std::string url;
+        int HTTPstatus{};
         bool bdf_zip{};
 
         static const std::unordered_map<std::string, std::regex> zip_types;
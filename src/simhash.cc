@@ -0,0 +1,80 @@
+#include "simhash.hh"
+#include "util.hh"
+
+namespace warc2text {
+
+    static const char* WHITESPACE = " \t\n\r\f\v";
+
+    // hash of the last count words, in text order, out of the ring buffer of the hashes of the first n words
+    static uint64_t shingleHash(const uint64_t* words, std::size_t n, std::size_t count) {
+        uint64_t shingle[SHINGLE_WORDS];
+        for (std::size_t i = 0; i < count; ++i)
+            shingle[i] = words[(n - count + i) % SHINGLE_WORDS];
+        return util::hashBytes(reinterpret_cast<const char*>(shingle), count * sizeof(uint64_t));
+    }
+
+    uint64_t simHash(const std::string& text) {
+        int counts[64] = {};
+        uint64_t words[SHINGLE_WORDS];
+        std::size_t n = 0;
+        auto add = [&counts](uint64_t hash) {
+            for (unsigned int bit = 0; bit < 64; ++bit)
+                counts[bit] += (hash >> bit) & 1 ? 1 : -1;
+        };
+
+        std::size_t start = text.find_first_not_of(WHITESPACE);
+        while (start != std::string::npos) {
+            std::size_t end = text.find_first_of(WHITESPACE, start);
+            if (end == std::string::npos)
+                end = text.size();
+            words[n % SHINGLE_WORDS] = util::hashBytes(text.data() + start, end - start);
+            if (++n >= SHINGLE_WORDS)
+                add(shingleHash(words, n, SHINGLE_WORDS));
+            start = text.find_first_not_of(WHITESPACE, end);
+        }
+        // short texts are a single shingle
+        if (n == 0)
+            return 0;
+        if (n < SHINGLE_WORDS)
+            add(shingleHash(words, n, n));
+
+        uint64_t hash = 0;
+        for (unsigned int bit = 0; bit < 64; ++bit)
+            if (counts[bit] > 0)
+                hash |= uint64_t(1) << bit;
+        return hash;
+    }
+
+    SimHashIndex::SimHashIndex(unsigned int distance) : distance(distance), bands(), tables(distance + 1) {
+        unsigned int shift = 0;
+        for (unsigned int i = 0; i <= distance; ++i) {
+            // the first bands take the remaining bits
+            unsigned int width = 64 / (distance + 1) + (i < 64 % (distance + 1) ? 1 : 0);
+            bands.emplace_back(shift, width);
+            shift += width;
+        }
+    }
+
+    uint64_t SimHashIndex::band(uint64_t hash, std::size_t i) const {
+        unsigned int width = bands[i].second;
+        uint64_t mask = width == 64 ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+        return (hash >> bands[i].first) & mask;
+    }
+
+    bool SimHashIndex::contains(uint64_t hash) const {
+        for (std::size_t i = 0; i < bands.size(); ++i) {
+            auto candidates = tables[i].find(band(hash, i));
+            if (candidates == tables[i].end())
+                continue;
+            for (uint64_t candidate : candidates->second)
+                if (static_cast<unsigned int>(__builtin_popcountll(candidate ^ hash)) <= distance)
+                    return true;
+        }
+        return false;
+    }
+
+    void SimHashIndex::add(uint64_t hash) {
+        for (std::size_t i = 0; i < bands.size(); ++i)
+            tables[i][band(hash, i)].push_back(hash);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef WARC2TEXT_SIMHASH_HH
+#define WARC2TEXT_SIMHASH_HH
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace warc2text {
+
+    // 64-bit SimHash of the shingles of SHINGLE_WORDS consecutive whitespace separated words of text
+    // texts that share most of their shingles get hashes that differ in few bits
+    uint64_t simHash(const std::string& text);
+
+    static const std::size_t SHINGLE_WORDS = 3;
+
+    // index of SimHashes to find near duplicates, with hashes split in distance + 1 bands:
+    // two hashes that differ in at most distance bits have at least one band in common
+    class SimHashIndex {
+        public:
+            explicit SimHashIndex(unsigned int distance);
+
+            // true if a hash that differs in at most distance bits is in the index
+            bool contains(uint64_t hash) const;
+            void add(uint64_t hash);
+
+        private:
+            unsigned int distance;
+            // shift and width of each band
+            std::vector<std::pair<unsigned int, unsigned int>> bands;
+            // for each band, the hashes with each value of that band
+            std::vector<std::unordered_map<uint64_t, std::vector<uint64_t>>> tables;
+
+            uint64_t band(uint64_t hash, std::size_t i) const;
+    };
+}
+
+#endif
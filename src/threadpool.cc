@@ -0,0 +1,37 @@
+#include "threadpool.hh"
+
+namespace util {
+    ThreadPool::ThreadPool(std::size_t threads) : stopping(false) {
+        for (std::size_t i = 0; i < threads; ++i)
+            workers.emplace_back(&ThreadPool::work, this);
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    std::size_t ThreadPool::size() const {
+        return workers.size();
+    }
+
+    void ThreadPool::work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return stopping or !tasks.empty(); });
+                // keep working until the queue is empty, even when stopping
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+}
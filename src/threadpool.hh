@@ -0,0 +1,49 @@
+#ifndef WARC2TEXT_THREADPOOL_HH
+#define WARC2TEXT_THREADPOOL_HH
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace util {
+    // fixed size pool of threads that run tasks in submission order
+    // destroying the pool waits for all submitted tasks to finish
+    class ThreadPool {
+        public:
+            explicit ThreadPool(std::size_t threads);
+            ~ThreadPool();
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
+
+            template <class F>
+            std::future<typename std::result_of<F()>::type> submit(F task) {
+                typedef typename std::result_of<F()>::type result_type;
+                auto packaged = std::make_shared<std::packaged_task<result_type()>>(std::move(task));
+                std::future<result_type> result = packaged->get_future();
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    tasks.emplace([packaged]() { (*packaged)(); });
+                }
+                condition.notify_one();
+                return result;
+            }
+
+            std::size_t size() const;
+
+        private:
+            std::vector<std::thread> workers;
+            std::queue<std::function<void()>> tasks;
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool stopping;
+
+            void work();
+    };
+}
+
+#endif
@@ -0,0 +1,280 @@
+#include "urlfilter.hh"
+#include <algorithm>
+#include <cctype>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/log/trivial.hpp>
+
+namespace warc2text {
+
+    static const uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    URLFilter::Trie::Trie() : nodes(1, Node{{}, 0, false, {}, NONE}) {}
+
+    uint32_t URLFilter::Trie::child(uint32_t node, unsigned char c) const {
+        for (const auto& next : nodes[node].children)
+            if (next.first == c)
+                return next.second;
+        return NONE;
+    }
+
+    void URLFilter::Trie::insert(const std::string& literal, uint32_t id) {
+        uint32_t node = 0;
+        for (unsigned char c : literal) {
+            uint32_t next = child(node, c);
+            if (next == NONE) {
+                next = nodes.size();
+                nodes[node].children.emplace_back(c, next);
+                nodes.push_back(Node{{}, 0, false, {}, NONE});
+            }
+            node = next;
+        }
+        nodes[node].terminal = true;
+        if (id != NONE)
+            nodes[node].ids.push_back(id);
+    }
+
+    bool URLFilter::Trie::empty() const {
+        return nodes[0].children.empty();
+    }
+
+    bool URLFilter::Trie::matchesPrefix(const std::string& text, bool reverse) const {
+        uint32_t node = 0;
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            node = child(node, text[reverse ? text.size() - 1 - i : i]);
+            if (node == NONE)
+                return false;
+            if (nodes[node].terminal)
+                return true;
+        }
+        return false;
+    }
+
+    void URLFilter::Trie::link() {
+        // breadth first, so that the failure links of shallower nodes are ready
+        std::deque<uint32_t> queue;
+        for (const auto& next : nodes[0].children) {
+            nodes[next.second].fail = 0;
+            queue.push_back(next.second);
+        }
+        while (not queue.empty()) {
+            uint32_t node = queue.front();
+            queue.pop_front();
+            for (const auto& next : nodes[node].children) {
+                uint32_t fail = nodes[node].fail;
+                while (fail != 0 and child(fail, next.first) == NONE)
+                    fail = nodes[fail].fail;
+                uint32_t target = child(fail, next.first);
+                nodes[next.second].fail = target == NONE ? 0 : target;
+                Node& target_node = nodes[nodes[next.second].fail];
+                nodes[next.second].terminal = nodes[next.second].terminal or target_node.terminal;
+                nodes[next.second].output = target_node.ids.empty() ? target_node.output : nodes[next.second].fail;
+                queue.push_back(next.second);
+            }
+        }
+    }
+
+    bool URLFilter::Trie::matchesAnywhere(const std::string& text) const {
+        uint32_t node = 0;
+        for (unsigned char c : text) {
+            uint32_t next = child(node, c);
+            while (next == NONE and node != 0) {
+                node = nodes[node].fail;
+                next = child(node, c);
+            }
+            node = next == NONE ? 0 : next;
+            if (nodes[node].terminal)
+                return true;
+        }
+        return false;
+    }
+
+    void URLFilter::Trie::find(const std::string& text, std::vector<uint32_t>& ids) const {
+        uint32_t node = 0;
+        for (unsigned char c : text) {
+            uint32_t next = child(node, c);
+            while (next == NONE and node != 0) {
+                node = nodes[node].fail;
+                next = child(node, c);
+            }
+            node = next == NONE ? 0 : next;
+            for (uint32_t found = nodes[node].ids.empty() ? nodes[node].output : node; found != NONE; found = nodes[found].output)
+                ids.insert(ids.end(), nodes[found].ids.begin(), nodes[found].ids.end());
+        }
+    }
+
+    // if pattern is literal text, optionally anchored at the start with ^ and at the end with $, sets literal and anchors
+    static bool parseLiteral(const std::string& pattern, std::string& literal, bool& start, bool& end) {
+        static const std::string special = ".[]{}()*+?|^$\\";
+        literal.clear();
+        start = boost::algorithm::starts_with(pattern, "^");
+        end = false;
+        for (std::size_t i = start ? 1 : 0; i < pattern.size(); ++i) {
+            char c = pattern[i];
+            if (c == '\\') {
+                // escaped punctuation is literal, except for the word and buffer boundaries \< \> \` \',
+                // and escaped letters and digits are classes, assertions or references
+                if (i + 1 == pattern.size() or not std::ispunct(static_cast<unsigned char>(pattern[i + 1]))
+                    or std::string("<>`'").find(pattern[i + 1]) != std::string::npos)
+                    return false;
+                literal += pattern[++i];
+            } else if (c == '$' and i + 1 == pattern.size()) {
+                end = true;
+            } else if (special.find(c) != std::string::npos) {
+                return false;
+            } else {
+                literal += c;
+            }
+        }
+        return not literal.empty();
+    }
+
+    // index of the ] that closes the set opened at start, where a leading ] (after an optional ^) is a member,
+    // and classes like [:alpha:], [=a=] and [.-.] are skipped whole
+    static std::size_t setEnd(const std::string& pattern, std::size_t start) {
+        std::size_t j = start + 1;
+        if (j < pattern.size() and pattern[j] == '^') ++j;
+        if (j < pattern.size() and pattern[j] == ']') ++j;
+        while (j < pattern.size() and pattern[j] != ']') {
+            if (pattern[j] == '[' and j + 1 < pattern.size() and std::string(":=.").find(pattern[j + 1]) != std::string::npos) {
+                std::size_t close = pattern.find(std::string(1, pattern[j + 1]) + "]", j + 2);
+                j = close == std::string::npos ? pattern.size() : close + 2;
+            } else {
+                j += pattern[j] == '\\' ? 2 : 1;
+            }
+        }
+        return std::min(j, pattern.size());
+    }
+
+    // longest literal text that every match of pattern contains, or empty if none is found
+    // only the top level of the pattern is looked at, and patterns with alternatives or flags have none
+    static std::string requiredLiteral(const std::string& pattern) {
+        if (pattern.find("(?") != std::string::npos)
+            return std::string();
+        std::string best, run;
+        int depth = 0;
+        // the last character of run is a single literal character, which a following quantifier may make optional
+        bool last_literal = false;
+        auto end_run = [&best, &run, &last_literal]() {
+            if (run.size() > best.size())
+                best = run;
+            run.clear();
+            last_literal = false;
+        };
+        for (std::size_t i = 0; i < pattern.size(); ++i) {
+            char c = pattern[i];
+            if (c == '\\') {
+                char next = i + 1 < pattern.size() ? pattern[++i] : '\0';
+                if (depth == 0 and std::ispunct(static_cast<unsigned char>(next)) and std::string("<>`'").find(next) == std::string::npos) {
+                    run += next;
+                    last_literal = true;
+                } else {
+                    end_run();
+                }
+            } else if (c == '[') {
+                i = setEnd(pattern, i);
+                end_run();
+            } else if (c == '(') {
+                ++depth;
+                end_run();
+            } else if (c == ')') {
+                --depth;
+                end_run();
+            } else if (c == '|') {
+                if (depth == 0)
+                    return std::string();
+                end_run();
+            } else if (c == '*' or c == '?' or c == '{') {
+                if (last_literal)
+                    run.pop_back();
+                if (c == '{')
+                    i = std::min(pattern.find('}', i), pattern.size());
+                end_run();
+            } else if (c == '+' or c == '.' or c == '^' or c == '$') {
+                end_run();
+            } else if (depth == 0) {
+                run += c;
+                last_literal = true;
+            }
+        }
+        end_run();
+        return best.size() >= 3 ? best : std::string();
+    }
+
+    URLFilter::URLFilter() : anywhere(), prefixes(), suffixes(), exact(), regexes(), regex(), required(), filtered() {}
+
+    void URLFilter::add(const std::string& pattern) {
+        std::string literal;
+        bool start, end;
+        if (not parseLiteral(pattern, literal, start, end)) {
+            literal = requiredLiteral(pattern);
+            if (literal.empty()) {
+                regexes.push_back(pattern);
+            } else {
+                required.insert(literal, filtered.size());
+                filtered.emplace_back(pattern, boost::regex::optimize | boost::regex::nosubs);
+            }
+        } else if (start and end) {
+            exact.insert(literal);
+        } else if (start) {
+            prefixes.insert(literal);
+        } else if (end) {
+            suffixes.insert(std::string(literal.rbegin(), literal.rend()));
+        } else {
+            anywhere.insert(literal);
+        }
+    }
+
+    void URLFilter::read(const std::string& filename) {
+        std::ifstream f(filename);
+        std::string line;
+        for (size_t line_i=1; std::getline(f, line); ++line_i) {
+            if (boost::algorithm::all(line, boost::algorithm::is_space()) || boost::algorithm::starts_with(line, "#"))
+                continue;
+            try {
+                (boost::regex(line)); // Compile, but just to test its validity.
+            } catch (const boost::regex_error& e) {
+                BOOST_LOG_TRIVIAL(warning) << "Could not parse url filter at " << filename << ":" << line_i << ": " << e.what();
+                continue;
+            }
+            add(line);
+        }
+        anywhere.link();
+        required.link();
+
+        std::string combined;
+        for (const std::string& pattern : regexes)
+            combined += (combined.empty() ? "(" : "|(") + pattern + ")";
+        if (!combined.empty())
+            regex.assign(combined, boost::regex::optimize | boost::regex::nosubs);
+    }
+
+    bool URLFilter::empty() const {
+        return anywhere.empty() and prefixes.empty() and suffixes.empty() and exact.empty() and regexes.empty() and filtered.empty();
+    }
+
+    bool URLFilter::matches(const std::string& url) const {
+        return exact.count(url) == 1
+            or prefixes.matchesPrefix(url, false)
+            or suffixes.matchesPrefix(url, true)
+            or anywhere.matchesAnywhere(url)
+            or matchesFiltered(url)
+            or (!regexes.empty() and boost::regex_search(url, regex));
+    }
+
+    bool URLFilter::matchesFiltered(const std::string& url) const {
+        if (filtered.empty())
+            return false;
+        std::vector<uint32_t> candidates;
+        required.find(url, candidates);
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        for (uint32_t candidate : candidates)
+            if (boost::regex_search(url, filtered[candidate]))
+                return true;
+        return false;
+    }
+}
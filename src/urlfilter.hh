@@ -0,0 +1,75 @@
+#ifndef WARC2TEXT_URLFILTER_HH
+#define WARC2TEXT_URLFILTER_HH
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <boost/regex.hpp>
+
+namespace warc2text {
+
+    // set of url patterns, regular expressions searched anywhere in the url
+    // patterns that are just literal text, optionally anchored with ^ and $, are matched with tries and a hash set
+    // the rest are regular expressions: those that can only match urls containing some literal text are searched
+    // only in urls where that text has been found, and the others are combined in a single regular expression
+    class URLFilter {
+        public:
+            URLFilter();
+
+            // one pattern per line, lines beginning with # and empty lines are ignored
+            // invalid patterns are warned about and skipped
+            void read(const std::string& filename);
+            bool empty() const;
+            // true if any pattern matches url
+            bool matches(const std::string& url) const;
+
+        private:
+            // byte trie, with failure links (Aho-Corasick) when used to find literals anywhere in a text
+            class Trie {
+                public:
+                    Trie();
+                    // with an id, matchesAnywhere reports it when literal is found
+                    void insert(const std::string& literal, uint32_t id = std::numeric_limits<uint32_t>::max());
+                    // true if any literal is a prefix of text, or with reverse, a prefix of text read backwards
+                    bool matchesPrefix(const std::string& text, bool reverse) const;
+                    // builds the failure links, needed by matchesAnywhere after the last insert
+                    void link();
+                    bool matchesAnywhere(const std::string& text) const;
+                    // ids of the literals found anywhere in text, in any order and possibly repeated
+                    void find(const std::string& text, std::vector<uint32_t>& ids) const;
+                    bool empty() const;
+
+                private:
+                    struct Node {
+                        std::vector<std::pair<unsigned char, uint32_t>> children;
+                        uint32_t fail;
+                        // a literal ends here, or at a node of the failure chain
+                        bool terminal;
+                        std::vector<uint32_t> ids;
+                        // closest node of the failure chain with ids
+                        uint32_t output;
+                    };
+                    std::vector<Node> nodes;
+
+                    uint32_t child(uint32_t node, unsigned char c) const;
+            };
+
+            Trie anywhere;
+            Trie prefixes;
+            Trie suffixes;
+            std::unordered_set<std::string> exact;
+            std::vector<std::string> regexes;
+            boost::regex regex;
+            // regular expressions with the literal text they require
+            Trie required;
+            std::vector<boost::regex> filtered;
+
+            void add(const std::string& pattern);
+            bool matchesFiltered(const std::string& url) const;
+    };
+}
+
+#endif
@@ -14,6 +14,10 @@
 #include <boost/log/trivial.hpp>
 #include <uchardet/uchardet.h>
 #include "preprocess/base64.hh"
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define WARC2TEXT_BASE64_SIMD
+#include <immintrin.h>
+#endif
 
 namespace util {
     void toLower(std::string& s){
@@ -83,13 +87,132 @@ namespace util {
     }
 
     void encodeBase64(const std::string& original, std::string& base64){
-        preprocess::base64_encode(original, base64);
+        base64.clear();
+        Base64Encoder encoder;
+        encoder.encode(original.data(), original.size(), base64);
+        encoder.finish(base64);
     }
 
     void decodeBase64(const std::string& base64, std::string& output){
         preprocess::base64_decode(base64, output);
     }
 
+    const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // encoders of complete 3-byte groups, they return the number of input bytes consumed
+    typedef std::size_t (*Base64Blocks)(const unsigned char* in, std::size_t size, char* out);
+
+    std::size_t encodeBase64Scalar(const unsigned char* in, std::size_t size, char* out) {
+        const unsigned char* start = in;
+        for (; size >= 3; size -= 3, in += 3, out += 4) {
+            out[0] = base64_chars[in[0] >> 2];
+            out[1] = base64_chars[((in[0] & 0x03) << 4) | (in[1] >> 4)];
+            out[2] = base64_chars[((in[1] & 0x0f) << 2) | (in[2] >> 6)];
+            out[3] = base64_chars[in[2] & 0x3f];
+        }
+        return in - start;
+    }
+
+#ifdef WARC2TEXT_BASE64_SIMD
+    // vectorized encoding by Wojciech Muła: bytes are spread so that every 32-bit lane holds one group,
+    // split into four 6-bit indices with multiplications, and translated to ASCII with a pshufb lookup
+    __attribute__((target("ssse3")))
+    std::size_t encodeBase64SSSE3(const unsigned char* in, std::size_t size, char* out) {
+        const unsigned char* start = in;
+        const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+        const __m128i shift_lut = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        // each step reads 16 bytes but only consumes 12
+        for (; size >= 16; size -= 12, in += 12, out += 16) {
+            __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)), spread);
+            __m128i hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+            __m128i lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+            __m128i indices = _mm_or_si128(hi, lo);
+            __m128i shift = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            shift = _mm_or_si128(shift, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+            shift = _mm_shuffle_epi8(shift_lut, shift);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_add_epi8(indices, shift));
+        }
+        return (in - start) + encodeBase64Scalar(in, size, out);
+    }
+
+    // same as above, with two groups of 12 bytes per step
+    __attribute__((target("avx2")))
+    std::size_t encodeBase64AVX2(const unsigned char* in, std::size_t size, char* out) {
+        const unsigned char* start = in;
+        const __m256i spread = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+                                               10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+        const __m256i shift_lut = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                   '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+                                                   'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                   '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+        // each step reads 28 bytes but only consumes 24
+        for (; size >= 28; size -= 24, in += 24, out += 32) {
+            __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in))),
+                                                _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 12)), 1);
+            v = _mm256_shuffle_epi8(v, spread);
+            __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+            __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+            __m256i indices = _mm256_or_si256(hi, lo);
+            __m256i shift = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+            shift = _mm256_or_si256(shift, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+            shift = _mm256_shuffle_epi8(shift_lut, shift);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_add_epi8(indices, shift));
+        }
+        return (in - start) + encodeBase64SSSE3(in, size, out);
+    }
+#endif
+
+    Base64Blocks selectBase64Blocks() {
+#ifdef WARC2TEXT_BASE64_SIMD
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return encodeBase64AVX2;
+        if (__builtin_cpu_supports("ssse3"))
+            return encodeBase64SSSE3;
+#endif
+        return encodeBase64Scalar;
+    }
+
+    void Base64Encoder::encode(const char* text, std::size_t size, std::string& base64) {
+        static const Base64Blocks encode_blocks = selectBase64Blocks();
+        const unsigned char* in = reinterpret_cast<const unsigned char*>(text);
+        const unsigned char* end = in + size;
+        // complete the group left over from the previous call first
+        if (pending_size > 0) {
+            while (pending_size < 3 && in < end)
+                pending[pending_size++] = *in++;
+            if (pending_size < 3) return;
+            char group[4];
+            encodeBase64Scalar(pending, 3, group);
+            base64.append(group, 4);
+            pending_size = 0;
+        }
+
+        std::size_t groups = (end - in) / 3;
+        if (groups > 0) {
+            std::size_t offset = base64.size();
+            base64.resize(offset + groups * 4);
+            in += encode_blocks(in, groups * 3, &base64[offset]);
+        }
+        while (in < end)
+            pending[pending_size++] = *in++;
+    }
+
+    void Base64Encoder::finish(std::string& base64) {
+        if (pending_size == 0) return;
+        base64.push_back(base64_chars[pending[0] >> 2]);
+        if (pending_size == 1) {
+            base64.push_back(base64_chars[(pending[0] & 0x03) << 4]);
+            base64.push_back('=');
+        } else {
+            base64.push_back(base64_chars[((pending[0] & 0x03) << 4) | (pending[1] >> 4)]);
+            base64.push_back(base64_chars[(pending[1] & 0x0f) << 2]);
+        }
+        base64.push_back('=');
+        pending_size = 0;
+    }
+
     void readTagFiltersRegex(const std::string& filename, umap_tag_filters_regex& filters) {
         std::ifstream f(filename);
         std::string line;
@@ -114,31 +237,6 @@ namespace util {
         f.close();
     }
 
-    void readUrlFiltersRegex(const std::string &filename, boost::regex &urlFilter) {
-        std::ifstream f(filename);
-        std::string line;
-        std::ostringstream combined;
-        bool first = true;
-        for (size_t line_i=1; std::getline(f, line); ++line_i) {
-            if (boost::algorithm::all(line, boost::algorithm::is_space()) || boost::algorithm::starts_with(line, "#"))
-                continue;
-            try {
-                (boost::regex(line)); // Compile, but just to test its validity.
-                if (first)
-                    first = false;
-                else
-                    combined << "|";
-                combined << "(" << line << ")";
-            } catch (const boost::regex_error& e) {
-                BOOST_LOG_TRIVIAL(warning) << "Could not parse url filter at " << filename << ":" << line_i << ": " << e.what();
-                continue;
-            }
-        }
-        f.close();
-
-        urlFilter.assign(combined.str(), boost::regex::optimize | boost::regex::nosubs);
-    }
-
     bool createDirectories(const std::string& path){
         if (!boost::filesystem::exists(path))
             return boost::filesystem::create_directories(path);
@@ -169,6 +267,46 @@ namespace util {
         return out.str();
     }
 
+    std::string getHost(const std::string& url) {
+        std::size_t start = url.find("://");
+        start = start == std::string::npos ? 0 : start + 3;
+        std::size_t end = url.find_first_of("/?#", start);
+        if (end == std::string::npos) end = url.size();
+        std::size_t at = url.rfind('@', end);
+        if (at != std::string::npos and at >= start) start = at + 1;
+        // keep ipv6 addresses in brackets whole
+        std::size_t colon = url.find(':', url[start] == '[' ? url.find(']', start) : start);
+        if (colon < end) end = colon;
+        return toLowerCopy(url.substr(start, end - start));
+    }
+
+    uint64_t hashBytes(const char* data, std::size_t size, uint64_t seed) {
+        const uint64_t m = 0xc6a4a7935bd1e995ULL;
+        const int r = 47;
+        const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+        uint64_t h = seed ^ (size * m);
+        // words are read as little endian, so that hashes do not depend on the platform
+        for (; size >= 8; size -= 8, in += 8) {
+            uint64_t k = 0;
+            for (int i = 7; i >= 0; --i)
+                k = (k << 8) | in[i];
+            k *= m;
+            k ^= k >> r;
+            k *= m;
+            h ^= k;
+            h *= m;
+        }
+        if (size > 0) {
+            for (int i = size - 1; i >= 0; --i)
+                h ^= uint64_t(in[i]) << (8 * i);
+            h *= m;
+        }
+        h ^= h >> r;
+        h *= m;
+        h ^= h >> r;
+        return h;
+    }
+
     std::vector<std::string> split(const std::string& s, const std::string& delimiter)
     {
         std::vector<std::string> result;
@@ -1,6 +1,7 @@
 #ifndef WARC2TEXT_UTIL_HH
 #define WARC2TEXT_UTIL_HH
 
+#include <cstdint>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -29,9 +30,29 @@ namespace util {
 
     void decodeBase64(const std::string& base64, std::string& output);
 
+    // base64 encoder for input that arrives in pieces, output is the same as encoding the concatenated input
+    class Base64Encoder {
+        public:
+            Base64Encoder() : pending_size(0) {};
+            // encode all complete 3-byte groups, keeping the remaining bytes for the next call
+            void encode(const char* text, std::size_t size, std::string& base64);
+            // encode the remaining bytes with padding, and reset the encoder
+            void finish(std::string& base64);
+        private:
+            unsigned char pending[3];
+            std::size_t pending_size;
+    };
+
     const std::string reserved_chars_url("!#$&'()*+,/:;=?[]");
     std::string encodeURLs(const std::string& url);
 
+    // lowercase host of a url, without scheme, user info or port
+    std::string getHost(const std::string& url);
+
+    // 64-bit MurmurHash64A, stable across runs and platforms
+    uint64_t hashBytes(const char* data, std::size_t size, uint64_t seed = 0);
+    inline uint64_t hashBytes(const std::string& data, uint64_t seed = 0) { return hashBytes(data.data(), data.size(), seed); }
+
     enum ErrorCode : int {
         SUCCESS = 0,
         HTML_PARSING_ERROR = 1,
@@ -55,7 +76,6 @@ namespace util {
 
     void readTagFiltersRegex(const std::string& filename, umap_tag_filters_regex& filters);
 
-    void readUrlFiltersRegex(const std::string &filename, boost::regex &urlFilter);
 
     bool createDirectories(const std::string& path);
 
@@ -3,34 +3,82 @@
 #include "util/compress.hh"
 #include <boost/log/trivial.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <unistd.h>
+#include <vector>
 
 namespace warc2text {
     const std::unordered_set<std::string> WARCPreprocessor::removeExtensions = {".jpg", ".jpeg", ".gif", ".png", ".css", ".js", ".mp3",
                                                                                 ".mp4", ".flv", ".wmv", ".gz", ".zip", ".rar" };
 
-    WARCPreprocessor::WARCPreprocessor(const std::string& outputFolder, const std::unordered_set<std::string>& output_files,
-                                       const std::string& pdf_warc_filename, const std::string& tagFiltersFile, bool invert,
-                                       const std::string& urlFiltersFile, bool multilang, bool encodeURLs,
-                                       bool paragraph_identification, bool tsv_output) :
-        writer(outputFolder, output_files),
+    WARCPreprocessor::WARCPreprocessor(const std::string& outputFolder, const OutputOptions& output,
+                                       const FilterOptions& filters, const DedupOptions& dedup) :
+        writer(outputFolder, output.files, output.compression, output.format, output.max_open_languages, output.shards,
+               output.shard_key, output.rotation, output.tsv_columns),
+        arrow_writer(output.arrow_filename.empty() ? nullptr : new ArrowWriter(output.arrow_filename, output.files.count("html") == 1)),
+        simhash_index(dedup.near ? new SimHashIndex(dedup.near_distance) : nullptr),
+        compute_simhash(dedup.near or std::count(output.tsv_columns.begin(), output.tsv_columns.end(), "simhash") > 0),
+        boilerplate_filter(filters.boilerplate_threshold > 0 ? new BoilerplateFilter(filters.boilerplate_threshold) : nullptr),
         totalRecords(0),
         textRecords(0),
         langRecords(0),
         totalBytes(0),
         textBytes(0),
         langBytes(0),
+        duplicateRecords(0),
+        duplicateBytes(0),
+        revisitRecords(0),
+        seenDigestRecords(0),
+        nearDuplicateRecords(0),
+        boilerplateBytes(0),
+        domainFilteredRecords(0),
+        HTTPfilteredRecords(0),
+        hostQuotaRecords(0),
+        unsampledRecords(0),
+        lidSampledRecords(0),
+        lidFallbackRecords(0),
         tagFilters(),
-        pdf_warc_filename(pdf_warc_filename),
-        invert(invert),
-        multilang(multilang),
-        encodeURLs(encodeURLs),
-        paragraph_identification(paragraph_identification),
-        tsv_output(tsv_output) {
-            if (!tagFiltersFile.empty())
-                util::readTagFiltersRegex(tagFiltersFile, tagFilters);
-
-            if (!urlFiltersFile.empty())
-                util::readUrlFiltersRegex(urlFiltersFile, urlFilter);
+        http_filters(filters.http),
+        max_docs_per_host(filters.max_docs_per_host),
+        host_docs(),
+        sample_rate(filters.sample_rate),
+        // below 1, sample_rate * 2^64 fits in 64 bits
+        sample_threshold(sample_rate < 1.0 ? static_cast<uint64_t>(std::ldexp(sample_rate, 64)) : std::numeric_limits<uint64_t>::max()),
+        sampleLangRecords(),
+        sampleLangBytes(),
+        pdf_warc_filename(output.pdf_warc_filename),
+        invert(filters.invert_tag_filters),
+        multilang(filters.multilang),
+        encodeURLs(output.encode_urls),
+        paragraph_identification(output.paragraph_identification),
+        tsv_output(output.tsv),
+        lid_bytes(filters.lid_bytes),
+        langs(filters.langs),
+        reject_langs(filters.reject_langs) {
+            if (!filters.tag_filters_file.empty())
+                util::readTagFiltersRegex(filters.tag_filters_file, tagFilters);
+
+            if (!filters.url_filters_file.empty())
+                urlFilter.read(filters.url_filters_file);
+
+            if (!filters.domain_filters_file.empty())
+                domain_filter.reset(new DomainFilter(filters.domain_filters_file));
+
+            if (!dedup.exact_table.empty())
+                dedup_set.reset(new HashSet(dedup.exact_table));
+            else if (dedup.exact)
+                dedup_set.reset(new HashSet());
+
+            if (!dedup.digest_table.empty())
+                digest_set.reset(new HashSet(dedup.digest_table));
+            else if (dedup.digest)
+                digest_set.reset(new HashSet());
         }
 
     // true if url is good
@@ -38,11 +86,12 @@ namespace warc2text {
         if (boost::algorithm::ends_with(url, "robots.txt"))
             return false;
 
-        for (const std::string& ext : removeExtensions)
-            if (boost::algorithm::ends_with(url, ext))
-                return false;
+        // every extension has a single dot, so it can only be what follows the last dot of the url
+        std::size_t dot = url.find_last_of('.');
+        if (dot != std::string::npos and removeExtensions.count(url.substr(dot)) == 1)
+            return false;
 
-        if (!urlFilter.empty() && boost::regex_search(url, urlFilter)) {
+        if (!urlFilter.empty() && urlFilter.matches(url)) {
             BOOST_LOG_TRIVIAL(info) << "Url filter matched '" << url << "'";
             return false;
         }
@@ -50,6 +99,129 @@ namespace warc2text {
         return true;
     }
 
+    static bool matchesMime(const std::vector<std::string>& mimes, const std::string& mime) {
+        for (const std::string& pattern : mimes) {
+            if (boost::algorithm::ends_with(pattern, "/*") ? boost::algorithm::starts_with(mime, pattern.substr(0, pattern.size() - 1))
+                                                          : mime == pattern)
+                return true;
+        }
+        return false;
+    }
+
+    // true if the HTTP response passes the status, length and MIME filters
+    bool WARCPreprocessor::HTTPfilter(const Record& record) const {
+        // resource records and responses without an HTTP header have no status to filter on
+        if (!http_filters.statuses.empty() and record.getHTTPstatus() != 0) {
+            std::string status = std::to_string(record.getHTTPstatus());
+            std::string status_class = status.substr(0, 1) + "xx";
+            if (http_filters.statuses.count(status) == 0 and http_filters.statuses.count(status_class) == 0)
+                return false;
+        }
+        std::size_t length = record.getPayload().size();
+        if (length < http_filters.min_length or (http_filters.max_length > 0 and length > http_filters.max_length))
+            return false;
+        if (!http_filters.mimes.empty() and !matchesMime(http_filters.mimes, record.getHTTPcontentType()))
+            return false;
+        if (matchesMime(http_filters.reject_mimes, record.getHTTPcontentType()))
+            return false;
+        return true;
+    }
+
+    void HTTPFilters::parse(const std::string& statuses, const std::string& mimes, const std::string& reject_mimes) {
+        std::vector<std::string> values;
+        if (!statuses.empty())
+            boost::algorithm::split(values, statuses, [](char c) {return c == ',';});
+        for (const std::string& status : values) {
+            if (status.size() != 3 or !std::isdigit(static_cast<unsigned char>(status[0]))
+                or !((std::isdigit(static_cast<unsigned char>(status[1])) and std::isdigit(static_cast<unsigned char>(status[2])))
+                     or status.substr(1) == "xx"))
+                throw std::invalid_argument("invalid status '" + status + "'");
+            this->statuses.insert(status);
+        }
+        if (!mimes.empty())
+            boost::algorithm::split(this->mimes, mimes, [](char c) {return c == ',';});
+        if (!reject_mimes.empty())
+            boost::algorithm::split(this->reject_mimes, reject_mimes, [](char c) {return c == ',';});
+        for (auto* list : {&this->mimes, &this->reject_mimes})
+            for (std::string& mime : *list)
+                util::toLower(mime);
+    }
+
+    bool HTTPFilters::empty() const {
+        return statuses.empty() and min_length == 0 and max_length == 0 and mimes.empty() and reject_mimes.empty();
+    }
+
+    // value of a WARC header field, case insensitive, or empty if not present
+    static std::string headerField(const std::string& header, const std::string& name) {
+        std::size_t pos = 0;
+        while ((pos = header.find("\r\n", pos)) != std::string::npos) {
+            pos += 2;
+            if (header.size() - pos > name.size() and header[pos + name.size()] == ':'
+                and boost::algorithm::iequals(header.substr(pos, name.size()), name)) {
+                std::size_t start = header.find_first_not_of(' ', pos + name.size() + 1);
+                std::size_t end = header.find("\r\n", pos);
+                return start < end ? header.substr(start, end - start) : std::string();
+            }
+        }
+        return std::string();
+    }
+
+    // true if a record has to be read, given its WARC header
+    bool WARCPreprocessor::headerFilter(const std::string& header) {
+        // the same records are sampled on every run, before any filter sees them
+        if (sample_rate < 1.0 and util::hashBytes(headerField(header, "WARC-Record-ID")) >= sample_threshold) {
+            ++unsampledRecords;
+            return false;
+        }
+        if (domain_filter or max_docs_per_host > 0) {
+            std::string url = headerField(header, "WARC-Target-URI");
+            if (!url.empty() && url[0] == '<' && url[url.size()-1] == '>')
+                url = url.substr(1, url.size()-2);
+            std::string host = util::getHost(url);
+            if (domain_filter and !url.empty() and domain_filter->blocked(host)) {
+                BOOST_LOG_TRIVIAL(trace) << "Record " << url << ": domain filtered";
+                ++domainFilteredRecords;
+                return false;
+            }
+            // hosts that already have their quota of documents are not read at all
+            if (max_docs_per_host > 0) {
+                auto docs = host_docs.find(util::hashBytes(host));
+                if (docs != host_docs.end() and docs->second >= max_docs_per_host) {
+                    BOOST_LOG_TRIVIAL(trace) << "Record " << url << ": host quota reached";
+                    ++hostQuotaRecords;
+                    return false;
+                }
+            }
+        }
+        return not digest_set or digestFilter(header);
+    }
+
+    // true if the payload of a record has not been seen before, given its WARC header
+    // revisit records always repeat an earlier payload
+    bool WARCPreprocessor::digestFilter(const std::string& header) {
+        std::string type = headerField(header, "WARC-Type");
+        if (boost::algorithm::iequals(type, "revisit")) {
+            ++revisitRecords;
+            return false;
+        }
+        if (not boost::algorithm::iequals(type, "response") and not boost::algorithm::iequals(type, "resource"))
+            return true;
+        std::string digest = headerField(header, "WARC-Payload-Digest");
+        if (digest.empty() or digest_set->insert(hash128(digest)))
+            return true;
+        ++seenDigestRecords;
+        return false;
+    }
+
+    // true if the record has any wanted language
+    // with multilang, the spans of unwanted languages are removed from the record
+    bool WARCPreprocessor::langFilter(Record& record) {
+        if (langs.empty() and reject_langs.empty())
+            return true;
+        if (multilang and not tsv_output)
+            return record.filterLanguageSpans(langs, reject_langs) > 0;
+        return languageAllowed(record.getLanguage(), langs, reject_langs);
+    }
 
     void WARCPreprocessor::process(const std::string& filename) {
         BOOST_LOG_TRIVIAL(info) << "Processing " << filename;
@@ -62,8 +234,12 @@ namespace warc2text {
         bool pdfpass = !pdf_warc_filename.empty();
         WARCWriter pdf_warc_writer;
 
+        std::function<bool(const std::string&)> keep;
+        if (digest_set or domain_filter or max_docs_per_host > 0 or sample_rate < 1.0)
+            keep = [this](const std::string& header) { return headerFilter(header); };
+
         while (!done) {
-            done = !reader.getRecord(content);
+            done = !reader.getRecord(content, 1024*1024*20, keep);
             ++totalRecords;
 
             if (done or content.empty())
@@ -84,17 +260,10 @@ namespace warc2text {
             if (not record.isTextFormat() and (boost::algorithm::ends_with(record.getURL(), ".pdf") or record.getHTTPcontentType() == "application/pdf")) {
                 // found a PDF file, write record to disk and continue
                 if (pdfpass) {
-                    // Work-around for https://github.com/bitextor/warc2text/issues/16 for ParaCrawl
-                    // we do not really have a use case for massive PDFs at this moment. Skip em.
-                    if (content.size() >= static_cast<std::size_t>(std::numeric_limits<uInt>::max())) {
-                        BOOST_LOG_TRIVIAL(info) << "PDF too large to compress with util::GZCompress";
-                        continue;
-                    }
-
                     if (!pdf_warc_writer.is_open())
                         pdf_warc_writer.open(pdf_warc_filename);
 
-                    pdf_warc_writer.writeRecord(content);
+                    pdf_warc_writer.writeRecord(reader, content);
                 }
                 continue;
             }
@@ -102,9 +271,18 @@ namespace warc2text {
             if (record.getPayload().size() > 5242880) // 5MB
                 continue;
 
+            if (!http_filters.empty() and !HTTPfilter(record)) {
+                BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": HTTP filtered";
+                ++HTTPfilteredRecords;
+                continue;
+            }
+
             if (!URLfilter(record.getURL()))
                 continue;
 
+            // counted against the quota of its host once written, the url may be encoded below
+            uint64_t host = max_docs_per_host > 0 ? util::hashBytes(util::getHost(record.getURL())) : 0;
+
             if (encodeURLs)
                 record.encodeURL();
 
@@ -140,6 +318,9 @@ namespace warc2text {
                 continue;
             }
 
+            if (boilerplate_filter)
+                boilerplateBytes += record.filterBoilerplate(*boilerplate_filter);
+
             if (record.getPlainText().empty()) {
                 BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": empty";
                 continue;
@@ -148,28 +329,84 @@ namespace warc2text {
             ++textRecords;
             textBytes += record.getPlainText().size();
 
-            if (!tsv_output) {
-                n_langs = record.detectLanguage(multilang);
-                if (n_langs == 1) {
-                    langBytes += record.getPlainText().size();
-                } else if (n_langs > 1) {
+            // exact duplicates are dropped before language identification and writing
+            if (dedup_set and not dedup_set->insert(hash128(record.getPlainText()))) {
+                BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": duplicate";
+                ++duplicateRecords;
+                duplicateBytes += record.getPlainText().size();
+                continue;
+            }
+
+            // the sketch is computed while the text is still in cache
+            if (compute_simhash)
+                record.computeSimHash();
+            if (simhash_index and simhash_index->contains(record.getSimHash())) {
+                BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": near duplicate";
+                ++nearDuplicateRecords;
+                continue;
+            }
+
+            // language identification runs once, its result is kept in the record for the writers
+            n_langs = record.detectLanguage(multilang, lid_bytes);
+            if (lid_bytes > 0 and record.getPlainText().size() > lid_bytes)
+                ++(record.getLanguageDetection().sampled ? lidSampledRecords : lidFallbackRecords);
+            // unwanted languages are dropped before any encoding or compression
+            if (!langFilter(record)) {
+                BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": language filtered";
+                continue;
+            }
+            // language filters may have removed some of the languages of a multilingual record
+            if (multilang and not tsv_output and n_langs > 0)
+                n_langs = spanLanguages(record.getLanguageSpans()).size();
+
+            if (n_langs == 0) {
+                BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": language not detected";
+            } else if (multilang and not tsv_output) {
+                if (n_langs > 1)
                     BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": multiple (" << n_langs << ") languages detected";
-                    for (auto it : record.getTextByLangs())
-                        langBytes += it.second.size();
+                for (const LanguageSpan& span : record.getLanguageSpans())
+                    langBytes += span.length;
+            } else {
+                langBytes += record.getPlainText().size();
+            }
+            langRecords += n_langs;
+            if (sample_rate < 1.0 and n_langs > 0) {
+                if (multilang and not tsv_output) {
+                    for (const LanguageSpan& span : record.getLanguageSpans())
+                        sampleLangBytes[span.lang] += span.length;
+                    for (const std::string& lang : spanLanguages(record.getLanguageSpans()))
+                        ++sampleLangRecords[lang];
                 } else {
-                    BOOST_LOG_TRIVIAL(trace) << "Record " << record.getURL() << ": language not detected";
-                    continue;
+                    ++sampleLangRecords[record.getLanguage()];
+                    sampleLangBytes[record.getLanguage()] += record.getPlainText().size();
                 }
+            }
 
-                langRecords += n_langs;
-            } else {
+            bool written = tsv_output or n_langs > 0;
+            if (tsv_output) {
+                // the tsv keeps records with unreliable language detection, with the best guess as language
                 writer.write_tsv(record);
+            } else if (n_langs > 0) {
+                writer.write(record, multilang, paragraph_identification);
             }
+            if (arrow_writer and written)
+                arrow_writer->write(record, multilang and not tsv_output);
+            if (max_docs_per_host > 0 and written)
+                ++host_docs[host];
+            // only written documents make later ones near duplicates
+            if (simhash_index and written)
+                simhash_index->add(record.getSimHash());
 
         }
         pdf_warc_writer.close();
     }
 
+    void WARCPreprocessor::close() {
+        writer.close();
+        if (arrow_writer)
+            arrow_writer->close();
+    }
+
     void WARCPreprocessor::printStatistics() const{
         BOOST_LOG_TRIVIAL(info) << "total records: " << totalRecords;
         BOOST_LOG_TRIVIAL(info) << "text records: " << textRecords;
@@ -178,6 +415,43 @@ namespace warc2text {
         BOOST_LOG_TRIVIAL(info) << "total bytes: " << totalBytes;
         BOOST_LOG_TRIVIAL(info) << "text bytes: " << textBytes;
         BOOST_LOG_TRIVIAL(info) << "lang bytes: " << langBytes;
+
+        if (domain_filter)
+            BOOST_LOG_TRIVIAL(info) << "domain filtered records: " << domainFilteredRecords;
+        if (!http_filters.empty())
+            BOOST_LOG_TRIVIAL(info) << "HTTP filtered records: " << HTTPfilteredRecords;
+        if (max_docs_per_host > 0)
+            BOOST_LOG_TRIVIAL(info) << "host quota records: " << hostQuotaRecords;
+        if (digest_set) {
+            BOOST_LOG_TRIVIAL(info) << "revisit records: " << revisitRecords;
+            BOOST_LOG_TRIVIAL(info) << "seen digest records: " << seenDigestRecords;
+        }
+        if (dedup_set) {
+            BOOST_LOG_TRIVIAL(info) << "duplicate records: " << duplicateRecords;
+            BOOST_LOG_TRIVIAL(info) << "duplicate bytes: " << duplicateBytes;
+            BOOST_LOG_TRIVIAL(info) << "dedup ratio: " << (textRecords ? static_cast<double>(duplicateRecords) / textRecords : 0.0);
+        }
+        if (simhash_index)
+            BOOST_LOG_TRIVIAL(info) << "near duplicate records: " << nearDuplicateRecords;
+        if (boilerplate_filter)
+            BOOST_LOG_TRIVIAL(info) << "boilerplate bytes: " << boilerplateBytes;
+        if (lid_bytes > 0) {
+            BOOST_LOG_TRIVIAL(info) << "lid sampled records: " << lidSampledRecords;
+            BOOST_LOG_TRIVIAL(info) << "lid fallback records: " << lidFallbackRecords;
+        }
+
+        if (sample_rate < 1.0) {
+            // totals of the whole input, estimated from the sampled records
+            BOOST_LOG_TRIVIAL(info) << "sample rate: " << sample_rate;
+            BOOST_LOG_TRIVIAL(info) << "unsampled records: " << unsampledRecords;
+            BOOST_LOG_TRIVIAL(info) << "estimated text records: " << std::llround(textRecords / sample_rate);
+            BOOST_LOG_TRIVIAL(info) << "estimated lang records: " << std::llround(langRecords / sample_rate);
+            BOOST_LOG_TRIVIAL(info) << "estimated text bytes: " << std::llround(textBytes / sample_rate);
+            BOOST_LOG_TRIVIAL(info) << "estimated lang bytes: " << std::llround(langBytes / sample_rate);
+            for (const auto& lang : sampleLangRecords)
+                BOOST_LOG_TRIVIAL(info) << "estimated " << lang.first << " records: " << std::llround(lang.second / sample_rate)
+                                        << ", bytes: " << std::llround(sampleLangBytes.at(lang.first) / sample_rate);
+        }
     }
 
     WARCWriter::WARCWriter() {
@@ -188,8 +462,9 @@ namespace warc2text {
         filename = warc_filename;
         if (not boost::algorithm::ends_with(filename, ".warc.gz"))
             filename += ".warc.gz";
-        std::string folder = filename.substr(0, filename.find_last_of('/'));
-        util::createDirectories(folder);
+        std::size_t slash = filename.find_last_of('/');
+        if (slash != std::string::npos)
+            util::createDirectories(filename.substr(0, slash));
         warc = std::fopen(filename.c_str(), "wb");
     }
 
@@ -201,8 +476,45 @@ namespace warc2text {
         if (warc) std::fclose(warc);
     }
 
-    void WARCWriter::writeRecord(const std::string& content) {
+    // append size bytes at offset of the file in to out, in the kernel if possible
+    bool copyRange(int in, std::size_t offset, std::size_t size, std::FILE* out) {
+        if (std::fflush(out) != 0)
+            return false;
+        off_t in_offset = offset;
+#ifdef __linux__
+        while (size > 0) {
+            ssize_t copied = copy_file_range(in, &in_offset, fileno(out), nullptr, size, 0);
+            // not supported between these files, copy the rest through user space
+            if (copied <= 0)
+                break;
+            size -= copied;
+        }
+#endif
+        std::vector<char> buffer(std::min<std::size_t>(size, 1024*1024));
+        while (size > 0) {
+            ssize_t read = pread(in, buffer.data(), std::min(size, buffer.size()), in_offset);
+            if (read <= 0 or std::fwrite(buffer.data(), 1, read, out) != static_cast<std::size_t>(read))
+                return false;
+            in_offset += read;
+            size -= read;
+        }
+        return true;
+    }
+
+    void WARCWriter::writeRecord(const WARCReader& reader, const std::string& content) {
         if (!warc) return;
+        int in = reader.getFileDescriptor();
+        if (in >= 0) {
+            if (!copyRange(in, reader.getRecordOffset(), reader.getRecordCompressedSize(), warc))
+                BOOST_LOG_TRIVIAL(error) << "Could not copy PDF record to " << filename;
+            return;
+        }
+        // Work-around for https://github.com/bitextor/warc2text/issues/16 for ParaCrawl
+        // we do not really have a use case for massive PDFs at this moment. Skip em.
+        if (content.size() >= static_cast<std::size_t>(std::numeric_limits<uInt>::max())) {
+            BOOST_LOG_TRIVIAL(info) << "PDF too large to compress with util::GZCompress";
+            return;
+        }
         std::string compressed;
         util::GZCompress(content, compressed);
         std::fwrite((void*) compressed.c_str(), 1, compressed.size(), warc);
@@ -3,9 +3,16 @@
 
 #include "record.hh"
 #include "warcreader.hh"
+#include "arrowwriter.hh"
 #include "bilangwriter.hh"
+#include "domainfilter.hh"
+#include "hashset.hh"
+#include "simhash.hh"
+#include "urlfilter.hh"
 #include "util.hh"
+#include <map>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <boost/regex.hpp>
 
@@ -19,37 +26,147 @@ namespace warc2text {
             void open(const std::string& warc_filename);
             void close();
             bool is_open();
-            void writeRecord(const std::string& content);
+            // copies the gzip member of the last record of reader as is, content is only compressed again
+            // if the input can not be read twice (stdin)
+            void writeRecord(const WARCReader& reader, const std::string& content);
+    };
+
+    // filters on the HTTP response, checked before the payload is cleaned
+    // statuses are codes (200) or classes (2xx), and MIME types are exact (text/html) or prefixes (text/*)
+    // empty lists and zero lengths do not filter
+    struct HTTPFilters {
+        std::unordered_set<std::string> statuses;
+        std::size_t min_length;
+        std::size_t max_length;
+        std::vector<std::string> mimes;
+        std::vector<std::string> reject_mimes;
+
+        HTTPFilters() : statuses(), min_length(0), max_length(0), mimes(), reject_mimes() {};
+
+        // sets the lists from comma separated values, throws std::invalid_argument with invalid statuses
+        void parse(const std::string& statuses, const std::string& mimes, const std::string& reject_mimes);
+        bool empty() const;
+    };
+
+    // where and how documents are written
+    struct OutputOptions {
+        std::unordered_set<std::string> files;
+        std::string pdf_warc_filename;
+        bool tsv;
+        std::vector<std::string> tsv_columns;
+        CompressionOptions compression;
+        TextFormat format;
+        std::string arrow_filename;
+        std::size_t max_open_languages;
+        std::size_t shards;
+        ShardKey shard_key;
+        RotationOptions rotation;
+        bool paragraph_identification;
+        bool encode_urls;
+
+        OutputOptions() : files(), pdf_warc_filename(), tsv(true), tsv_columns(BilangWriter::DEFAULT_TSV_COLUMNS),
+                          compression(), format(TextFormat::BASE64), arrow_filename(), max_open_languages(0), shards(1),
+                          shard_key(ShardKey::URL), rotation(), paragraph_identification(false), encode_urls(false) {};
+    };
+
+    // language identification, and which records and documents are kept
+    struct FilterOptions {
+        std::string tag_filters_file;
+        bool invert_tag_filters;
+        std::string url_filters_file;
+        std::string domain_filters_file;
+        HTTPFilters http;
+        bool multilang;
+        std::size_t lid_bytes;
+        std::unordered_set<std::string> langs;
+        std::unordered_set<std::string> reject_langs;
+        std::size_t boilerplate_threshold;
+        std::size_t max_docs_per_host;
+        double sample_rate;
+
+        FilterOptions() : tag_filters_file(), invert_tag_filters(false), url_filters_file(), domain_filters_file(), http(),
+                          multilang(false), lid_bytes(0), langs(), reject_langs(), boilerplate_threshold(0),
+                          max_docs_per_host(0), sample_rate(1.0) {};
+    };
+
+    // duplicate removal, hashes are kept in memory unless a table file is given
+    struct DedupOptions {
+        bool exact;
+        std::string exact_table;
+        bool digest;
+        std::string digest_table;
+        bool near;
+        unsigned int near_distance;
+
+        DedupOptions() : exact(false), exact_table(), digest(false), digest_table(), near(false), near_distance(3) {};
     };
 
     class WARCPreprocessor {
         private:
             BilangWriter writer;
-            GzipWriter single_writer;
+            CompressedWriter single_writer;
+            std::unique_ptr<ArrowWriter> arrow_writer;
+            // hashes of the text of documents written so far, when removing exact duplicates
+            std::unique_ptr<HashSet> dedup_set;
+            // WARC-Payload-Digest of the records seen so far, when skipping repeated payloads
+            std::unique_ptr<HashSet> digest_set;
+            // SimHashes of the documents written so far, when removing near duplicates
+            std::unique_ptr<SimHashIndex> simhash_index;
+            bool compute_simhash;
+            std::unique_ptr<BoilerplateFilter> boilerplate_filter;
             unsigned int totalRecords;
             unsigned int textRecords;
             unsigned int langRecords;
-            unsigned int totalBytes;
-            unsigned int textBytes;
-            unsigned int langBytes;
+            uint64_t totalBytes;
+            uint64_t textBytes;
+            uint64_t langBytes;
+            unsigned int duplicateRecords;
+            uint64_t duplicateBytes;
+            unsigned int revisitRecords;
+            unsigned int seenDigestRecords;
+            unsigned int nearDuplicateRecords;
+            uint64_t boilerplateBytes;
+            unsigned int domainFilteredRecords;
+            unsigned int HTTPfilteredRecords;
+            unsigned int hostQuotaRecords;
+            unsigned int unsampledRecords;
+            unsigned int lidSampledRecords;
+            unsigned int lidFallbackRecords;
             util::umap_tag_filters_regex tagFilters;
-            boost::regex urlFilter;
+            URLFilter urlFilter;
+            std::unique_ptr<DomainFilter> domain_filter;
+            HTTPFilters http_filters;
+            // documents written of each host (by the hash of its name), when limited to max_docs_per_host
+            std::size_t max_docs_per_host;
+            std::unordered_map<uint64_t, std::size_t> host_docs;
+            // records are kept if the hash of their WARC-Record-ID is below sample_threshold, statistics are extrapolated
+            double sample_rate;
+            uint64_t sample_threshold;
+            std::map<std::string, uint64_t> sampleLangRecords;
+            std::map<std::string, uint64_t> sampleLangBytes;
             std::string pdf_warc_filename;
             bool invert;
             bool multilang;
             bool encodeURLs;
             bool paragraph_identification;
             bool tsv_output;
+            std::size_t lid_bytes;
+            std::unordered_set<std::string> langs;
+            std::unordered_set<std::string> reject_langs;
 
             static const std::unordered_set<std::string> removeExtensions;
             bool URLfilter(const std::string& url);
+            bool langFilter(Record& record);
+            bool HTTPfilter(const Record& record) const;
+            bool headerFilter(const std::string& header);
+            bool digestFilter(const std::string& header);
 
         public:
-            explicit WARCPreprocessor(const std::string& outputFolder, const std::unordered_set<std::string>& output_files = {},
-                                      const std::string& pdf_warc_filename = "", const std::string& tagFiltersFile = "",
-                                      bool invert = false, const std::string& urlFiltersFile = "", bool multilang = false,
-                                      bool encodeURLs = false, bool paragraph_identification = false, bool tsv_output = true);
+            explicit WARCPreprocessor(const std::string& outputFolder, const OutputOptions& output = OutputOptions(),
+                                      const FilterOptions& filters = FilterOptions(), const DedupOptions& dedup = DedupOptions());
             void process(const std::string &filename);
+            // finish and close all output files, throws WriteError if any of them fails
+            void close();
             void printStatistics() const;
     };
 }
@@ -1,11 +1,18 @@
 #include "warcreader.hh"
 #include <boost/log/trivial.hpp>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
 
 namespace warc2text {
     WARCReader::WARCReader(){
         warc_filename = "";
         file = nullptr;
+        file_offset = 0;
+        record_offset = 0;
+        record_compressed_size = 0;
+        regular_file = false;
 
         buf = new uint8_t[BUFFER_SIZE];
         scratch = new uint8_t[BUFFER_SIZE];
@@ -33,11 +40,14 @@ namespace warc2text {
         closeFile();
     }
 
-    bool WARCReader::getRecord(std::string& out, std::size_t max_size){
+    bool WARCReader::getRecord(std::string& out, std::size_t max_size, const std::function<bool(const std::string&)>& keep){
         int inflate_ret = 0;
         out.clear();
         std::size_t len;
         bool skip_record = false;
+        bool header_checked = not keep;
+        // every record is a gzip member, which starts where the previous one ended
+        record_offset = file_offset - s.avail_in;
         while (inflate_ret != Z_STREAM_END) {
             if (s.avail_in == 0) {
                 len = readChunk();
@@ -60,6 +70,16 @@ namespace warc2text {
                     return false;
                 }
                 if (not skip_record) out.append(scratch, scratch + (BUFFER_SIZE - s.avail_out));
+                if (not header_checked) {
+                    std::size_t header_end = out.find("\r\n\r\n", out.size() - std::min(out.size(), BUFFER_SIZE - s.avail_out + 3));
+                    if (header_end != std::string::npos) {
+                        header_checked = true;
+                        if (not keep(out.substr(0, header_end + 4))) {
+                            out.clear();
+                            skip_record = true;
+                        }
+                    }
+                }
                 if (out.size() > max_size) {
                     BOOST_LOG_TRIVIAL(trace) << "WARC " << warc_filename << ": skipping large record";
                     out.clear();
@@ -67,6 +87,7 @@ namespace warc2text {
                 }
             }
             if (inflate_ret == Z_STREAM_END) {
+                record_compressed_size = file_offset - s.avail_in - record_offset;
                 if (inflateReset(&s) != Z_OK) {
                   BOOST_LOG_TRIVIAL(error) << "Failed to reset zlib";
                   abort();
@@ -77,6 +98,18 @@ namespace warc2text {
         return true;
     }
 
+    std::size_t WARCReader::getRecordOffset() const {
+        return record_offset;
+    }
+
+    std::size_t WARCReader::getRecordCompressedSize() const {
+        return record_compressed_size;
+    }
+
+    int WARCReader::getFileDescriptor() const {
+        return regular_file ? fileno(file) : -1;
+    }
+
     void WARCReader::openFile(const std::string& filename){
         warc_filename = filename;
         if (filename.empty() || filename == "-")
@@ -84,7 +117,12 @@ namespace warc2text {
         else file = std::fopen(filename.c_str(), "r");
         if (!file) {
             BOOST_LOG_TRIVIAL(error) << "WARC " << filename << ": file opening failed, skipping this WARC";
+            return;
         }
+        struct stat st;
+        regular_file = fstat(fileno(file), &st) == 0 and S_ISREG(st.st_mode);
+        // stdin may be a file that has already been partially read
+        if (regular_file) file_offset = std::max<off_t>(lseek(fileno(file), 0, SEEK_CUR), 0);
     }
 
     void WARCReader::closeFile() {
@@ -97,6 +135,7 @@ namespace warc2text {
             BOOST_LOG_TRIVIAL(error) << "WARC " << warc_filename << ": error during reading";
             return 0;
         }
+        file_offset += len;
         return len;
     }
 
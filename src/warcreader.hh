@@ -2,6 +2,7 @@
 #define WARC2TEXT_WARCREADER_HH
 
 #include "zlib.h"
+#include <functional>
 #include <string>
 
 namespace warc2text {
@@ -9,7 +10,15 @@ namespace warc2text {
         public:
             WARCReader();
             explicit WARCReader(const std::string& filename);
-            bool getRecord(std::string& out, std::size_t max_size = 1024*1024*20); //20MB
+            // keep is called with the WARC header as soon as it has been decompressed, and if it returns false
+            // the rest of the record is only decompressed to find its end, and out is left empty
+            bool getRecord(std::string& out, std::size_t max_size = 1024*1024*20, //20MB
+                           const std::function<bool(const std::string&)>& keep = nullptr);
+            // position and size of the gzip member of the last record in the input file
+            std::size_t getRecordOffset() const;
+            std::size_t getRecordCompressedSize() const;
+            // file descriptor of the input, or -1 if it is not a regular file whose records can be read again
+            int getFileDescriptor() const;
             ~WARCReader();
         private:
             std::FILE* file;
@@ -18,6 +27,11 @@ namespace warc2text {
             static const std::size_t BUFFER_SIZE = 4096;
             uint8_t* buf;
             uint8_t* scratch;
+            // bytes read from the input so far
+            std::size_t file_offset;
+            std::size_t record_offset;
+            std::size_t record_compressed_size;
+            bool regular_file;
 
             void openFile(const std::string& filename);
             void closeFile();
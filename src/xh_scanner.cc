@@ -1,6 +1,7 @@
 #include <cctype>
 #include <cstring>
 #include "xh_scanner.hh"
+#include "entities.hh"
 
 namespace markup {
 
@@ -34,16 +35,19 @@ namespace markup {
 
         if (c == 0) return TT_EOF;
         else if (c == '<') return scan_tag();
-        // else if (c == '&') {
-        //     c = scan_entity();
-        //     ws = is_whitespace(c);
-        // }
-        else
+        else if (c == '&') {
+            // entities are decoded straight into value, they are never whitespace
+            scan_entity();
+            ws = false;
+            c = get_char();
+        }
+        else {
             ws = is_whitespace(c);
-
-        while (true) {
             append_value(c);
             c = get_char();
+        }
+
+        while (true) {
             if (c == 0) {
                 push_back(c);
                 break;
@@ -62,10 +66,57 @@ namespace markup {
                 break;
             }
 
+            append_value(c);
+            c = get_char();
         }
         return ws ? TT_SPACE : TT_WORD;
     }
 
+    // caller already consumed '&'
+    // appends the decoded entity to value, or the consumed chars as they are if it is not a proper entity
+    void scanner::scan_entity() {
+        char body[MAX_ENTITY_SIZE];
+        unsigned int body_length = 0;
+        bool numeric = false;
+        bool hex = false;
+
+        char c = get_char();
+        if (c == '#') {
+            numeric = true;
+            body[body_length++] = c;
+            c = get_char();
+            if (c == 'x' || c == 'X') {
+                hex = true;
+                body[body_length++] = c;
+                c = get_char();
+            }
+        }
+
+        while (c != ';') {
+            bool alpha = std::isalpha(static_cast<unsigned char>(c));
+            bool digit = std::isdigit(static_cast<unsigned char>(c));
+            bool xdigit = std::isxdigit(static_cast<unsigned char>(c));
+            // decimal entities must only have digits, hex entities must only have xdigits,
+            // and entities may only contain digits and alpha chars (no entity is longer than MAX_ENTITY_SIZE)
+            if (c == 0 || (numeric && !hex && alpha) || (hex && !xdigit) || (!alpha && !digit)
+                || body_length == MAX_ENTITY_SIZE) {
+                // not an entity: keep the consumed chars and continue from the offending one
+                push_back(c);
+                append_value('&');
+                for (unsigned int i = 0; i < body_length; ++i)
+                    append_value(body[i]);
+                return;
+            }
+            body[body_length++] = c;
+            c = get_char();
+        }
+
+        std::string decoded;
+        entities::decodeEntity(std::string(body, body_length), decoded);
+        for (char d : decoded)
+            append_value(d);
+    }
+
     scanner::token_type scanner::scan_head() {
         char c = skip_whitespace();
 
@@ -41,7 +41,7 @@ namespace markup {
         };
 
         enum $ {
-            MAX_TOKEN_SIZE = 1024, MAX_NAME_SIZE = 128
+            MAX_TOKEN_SIZE = 1024, MAX_NAME_SIZE = 128, MAX_ENTITY_SIZE = 32
         };
 
     public:
@@ -89,6 +89,8 @@ namespace markup {
 
         token_type scan_entity_decl();
 
+        void scan_entity();
+
         char skip_whitespace();
 
         void push_back(char c);
@@ -0,0 +1,59 @@
+// checks that URLFilter matches the same urls as searching each pattern with boost::regex
+// returns 1 and prints the differences otherwise
+
+#include "src/urlfilter.hh"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <boost/regex.hpp>
+
+int main() {
+    const std::vector<std::string> patterns = {
+        // literals, anchored and not
+        "example\\.com", "^http://exact\\.org/$", "^https://prefix\\.", "\\.pdf$",
+        // regular expressions with a required literal
+        "ads[0-9]+\\.tracker", "banner.*\\.gif", "x?abcdef",
+        // sets that contain ] or classes, whose closing ] is not the end of the set
+        "[[:alpha:]]abc", "[[:digit:][:space:]]zzzq", "[[=e=]]pqrs", "[[.-.]]hyph", "[]x]lmno", "[^]x]rstu",
+        // nothing required
+        "(foo|bar)baz", "^[0-9]+$"
+    };
+    const std::vector<std::string> urls = {
+        "http://www.example.com/", "http://exact.org/", "http://exact.org/x", "https://prefix.net/a", "http://x/doc.pdf",
+        "http://ads42.tracker/", "http://x/banner123.gif", "http://x/abcdef", "http://q/xabc", "http://q/9abc",
+        "http://q/ abc", "http://q/7zzzq", "http://q/ zzzq", "http://q/xzzzq", "http://q/epqrs", "http://q/-hyph",
+        "http://q/xhyph", "http://q/]lmno", "http://q/xlmno", "http://q/ylmno", "http://q/yrstu", "http://q/]rstu",
+        "http://q/foobaz", "12345", "http://nothing.here/"
+    };
+
+    char filename[] = "/tmp/urlfilter_testXXXXXX";
+    int fd = mkstemp(filename);
+    if (fd < 0) {
+        std::perror("mkstemp");
+        return 1;
+    }
+    close(fd);
+    std::ofstream file(filename);
+    for (const std::string& pattern : patterns)
+        file << pattern << "\n";
+    file.close();
+
+    warc2text::URLFilter filter;
+    filter.read(filename);
+    std::remove(filename);
+
+    int errors = 0;
+    for (const std::string& url : urls) {
+        bool expected = false;
+        for (const std::string& pattern : patterns)
+            expected = expected or boost::regex_search(url, boost::regex(pattern));
+        if (filter.matches(url) != expected) {
+            std::cerr << url << ": expected " << (expected ? "a match" : "no match") << std::endl;
+            ++errors;
+        }
+    }
+    return errors > 0;
+}
@@ -22,8 +22,38 @@ struct Options {
     std::string tag_filters_filename;
     bool tag_filters_invert{};
     std::string url_filters_filename;
+    std::string domain_filters_filename;
+    std::string compile_domain_filters;
+    std::string http_status;
+    std::size_t min_content_length{};
+    std::size_t max_content_length{};
+    std::string mimes;
+    std::string reject_mimes;
+    std::size_t max_docs_per_host{};
+    double sample_rate{};
     bool multilang{};
     bool encodeURLs{};
+    std::size_t lid_bytes{};
+    std::string langs;
+    std::string reject_langs;
+    std::string compression;
+    std::string text_format;
+    std::string arrow;
+    std::size_t max_open_languages{};
+    std::size_t shards{};
+    std::string shard_by;
+    std::size_t rotate_bytes{};
+    std::size_t rotate_input_bytes{};
+    std::size_t rotate_records{};
+    std::size_t compression_threads{};
+    std::string tsv_columns;
+    bool dedup{};
+    std::string dedup_table;
+    bool digest_dedup{};
+    std::string digest_table;
+    bool near_dedup{};
+    unsigned int near_dedup_distance{};
+    std::size_t boilerplate_threshold{};
 };
 
 void parseArgs(int argc, char *argv[], Options& out) {
@@ -31,18 +61,48 @@ void parseArgs(int argc, char *argv[], Options& out) {
     po::options_description desc("Arguments");
     desc.add_options()
         ("help,h", po::bool_switch(), "Show this help message")
-        ("output,o", po::value(&out.output)->default_value("."), "Output folder")
+        ("output,o", po::value(&out.output)->default_value("."), "Output folder, or '-' for standard output")
         ("files,f", po::value(&out.files)->default_value("url,token"), "List of output files separated by commas. Default (mandatory files): 'url,text'. Optional: 'mime,html'")
         ("input,i", po::value(&out.warcs)->multitoken(), "Input WARC file name(s)")
         ("tag-filters", po::value(&out.tag_filters_filename), "Plain text file containing tag filters")
         ("invert-tag-filters", po::bool_switch(&out.tag_filters_invert)->default_value(false), "Invert tag filter application")
         ("url-filters", po::value(&out.url_filters_filename), "Plain text file containing url filters")
+        ("domain-filters", po::value(&out.domain_filters_filename), "File containing domains to discard, with their subdomains")
+        ("compile-domain-filters", po::value(&out.compile_domain_filters), "Write the --domain-filters list as a table to this file and exit")
+        ("http-status", po::value(&out.http_status), "List of HTTP status codes or classes (2xx) to keep separated by commas")
+        ("min-content-length", po::value(&out.min_content_length)->default_value(0), "Discard responses with a smaller body")
+        ("max-content-length", po::value(&out.max_content_length)->default_value(0), "Discard responses with a larger body")
+        ("mime", po::value(&out.mimes), "List of MIME types (or text/*) to keep separated by commas")
+        ("reject-mime", po::value(&out.reject_mimes), "List of MIME types (or text/*) to discard separated by commas")
+        ("max-docs-per-host", po::value(&out.max_docs_per_host)->default_value(0), "Maximum number of documents written of each host")
+        ("sample-rate", po::value(&out.sample_rate)->default_value(1.0), "Process only this fraction of the records and estimate totals")
         ("pdfpass", po::value(&out.pdf_warc_filename), "Write PDF records to WARC")
         ("paragraph-identification", po::bool_switch(&out.paragraph_identification)->default_value(false), "Add paragraph index in each b64encoded document as tab separated column")
         ("verbose,v", po::bool_switch(&out.verbose)->default_value(false), "Verbosity level")
         ("silent,s", po::bool_switch(&out.silent)->default_value(false))
         ("multilang", po::bool_switch(&out.multilang)->default_value(false), "Detect multiple languages in a single record")
-        ("encode-urls", po::bool_switch(&out.encodeURLs)->default_value(false), "Encode URLs obtained from WARC records");
+        ("encode-urls", po::bool_switch(&out.encodeURLs)->default_value(false), "Encode URLs obtained from WARC records")
+        ("lid-bytes", po::value(&out.lid_bytes)->default_value(0), "Detect language on a sample of this many bytes of each document")
+        ("langs", po::value(&out.langs), "List of languages to keep separated by commas")
+        ("reject-langs", po::value(&out.reject_langs), "List of languages to discard separated by commas")
+        ("tsv-columns", po::value(&out.tsv_columns)->default_value("lang,date,digest,url,text"), "Columns of the tsv output separated by commas")
+        ("dedup", po::bool_switch(&out.dedup)->default_value(false), "Remove documents whose text is an exact duplicate of a previous one")
+        ("dedup-table", po::value(&out.dedup_table), "Keep the hashes of --dedup in this file, across runs")
+        ("digest-dedup", po::bool_switch(&out.digest_dedup)->default_value(false), "Skip revisit records and records whose WARC-Payload-Digest was seen before")
+        ("digest-table", po::value(&out.digest_table), "Keep the digests of --digest-dedup in this file, across runs")
+        ("near-dedup", po::bool_switch(&out.near_dedup)->default_value(false), "Remove documents whose SimHash is close to a previous one")
+        ("near-dedup-distance", po::value(&out.near_dedup_distance)->default_value(3), "Maximum number of different SimHash bits of near duplicates")
+        ("boilerplate-threshold", po::value(&out.boilerplate_threshold)->default_value(0), "Remove paragraphs found in more than this many documents of a host")
+        ("text-format", po::value(&out.text_format)->default_value("base64"), "Write documents as base64 lines or as raw framed UTF-8")
+        ("arrow", po::value(&out.arrow), "Also write documents to an Arrow IPC file")
+        ("max-open-languages", po::value(&out.max_open_languages)->default_value(64), "Maximum number of languages with open output files")
+        ("shards", po::value(&out.shards)->default_value(1), "Split the output of each language in this many shards")
+        ("shard-by", po::value(&out.shard_by)->default_value("url"), "Assign records to shards by a hash of their 'url' or 'host'")
+        ("rotate-bytes", po::value(&out.rotate_bytes)->default_value(0), "Start a new numbered output file after this many compressed bytes")
+        ("rotate-input-bytes", po::value(&out.rotate_input_bytes)->default_value(0), "Start a new numbered output file after this many uncompressed bytes")
+        ("rotate-records", po::value(&out.rotate_records)->default_value(0), "Start a new numbered output file after this many records")
+        ("compression", po::value(&out.compression)->default_value("gzip"), "Compression codec of the output files")
+        ("compression-threads", po::value(&out.compression_threads)->default_value(0), "Compress output in parallel blocks using this many threads");
 
     po::positional_options_description pd;
     pd.add("input", -1);
@@ -53,18 +113,75 @@ void parseArgs(int argc, char *argv[], Options& out) {
         std::cerr << "Usage: " << argv[0] << " -o <output_folder> [ -f <output_files> ] [ --pdfpass <output_warc> ] [ --paragraph-identification ] [ --tag-filters <filters_file> ] <warc_file>...\n"
                 "\n"
                 "Options:\n"
-                " -o <output_folder>               Output folder, required\n"
+                " -o <output_folder>               Output folder, required; \"-\" writes the tsv output to stdout\n"
                 " -f <output_files>                List of output files separated by commas\n"
                 "                                  Default (mandatory): \"url,text\"\n"
                 "                                  Optional values: \"mime,html\"\n"
                 " --multilang                      Detect multiple languages in documents (up to 3),\n"
                 "                                  write as many text records as languages detected\n"
+                " --lid-bytes <bytes>              Detect language on a sample of <bytes> taken from the head,\n"
+                "                                  middle and tail of the document, falling back to the whole\n"
+                "                                  document if the sample is unreliable or mixed\n"
+                " --langs <langs>                  Only write documents in these languages (comma separated)\n"
+                " --reject-langs <langs>           Do not write documents in these languages (comma separated)\n"
+                " --dedup                          Remove documents whose text is identical to a previous one\n"
+                " --dedup-table <file>             Keep the text hashes of --dedup in <file>, so that documents\n"
+                "                                  seen in previous runs are removed too (implies --dedup)\n"
+                " --digest-dedup                   Skip revisit records, and records with a WARC-Payload-Digest\n"
+                "                                  seen before, without parsing their payload\n"
+                " --digest-table <file>            Keep the digests of --digest-dedup in <file>, so that payloads\n"
+                "                                  seen in previous runs are skipped too (implies --digest-dedup)\n"
+                " --near-dedup                     Remove documents whose 64-bit SimHash differs in at most\n"
+                "                                  --near-dedup-distance bits (default 3) from a previous one\n"
+                " --boilerplate-threshold <n>      Remove paragraphs that have been seen in more than <n> documents\n"
+                "                                  of the same host, like menus and footers (default 0: keep all)\n"
                 " --tag-filters <filters_files>    File containing html tag filters\n"
                 "                                  Format: \"html_tag <tab> tag_attr <tab> regexp\"\n"
                 " --invert-tag-filters             Only output records that got filtered\n"
                 " --url-filters <filters_file>     File containing url filters\n"
                 "                                  Format: \"regexp\"\n"
+                " --domain-filters <filters_file>  File containing domains to discard, with all their subdomains,\n"
+                "                                  one per line, or a table written by --compile-domain-filters\n"
+                " --compile-domain-filters <table> Write the --domain-filters list to <table>, which loads\n"
+                "                                  instantly, and exit\n"
+                " --http-status <codes>            Only process responses with these HTTP status codes or classes\n"
+                "                                  (comma separated, e.g. \"200,3xx\"), records without an HTTP\n"
+                "                                  status line (resource records) are kept\n"
+                " --min-content-length <bytes>     Discard responses with a body smaller than <bytes>\n"
+                " --max-content-length <bytes>     Discard responses with a body larger than <bytes>\n"
+                " --mime <types>                   Only process responses with these MIME types (comma separated,\n"
+                "                                  \"text/*\" for all text types)\n"
+                " --reject-mime <types>            Discard responses with these MIME types\n"
+                " --max-docs-per-host <n>          Write at most <n> documents of each host, later records of the\n"
+                "                                  host are skipped before extraction (default 0: no limit)\n"
+                " --sample-rate <p>                Process only a fraction <p> (0 < p <= 1) of the records, chosen\n"
+                "                                  by a hash of their WARC-Record-ID, and estimate totals for the\n"
+                "                                  whole input in the statistics (default 1: all records)\n"
                 " --pdfpass <output_warc>          Write PDF records to <output_warc>\n"
+                " --tsv-columns <columns>          Columns of the tsv output (default \"lang,date,digest,url,text\"),\n"
+                "                                  any of lang, date, digest, url, mime, simhash followed by text\n"
+                "                                  or html\n"
+                " --text-format <format>           Write documents as \"base64\" lines (default), or as \"framed\"\n"
+                "                                  raw UTF-8 records (see src/framereader.hh)\n"
+                " --arrow <file>                   Also write documents to an Arrow IPC file, with columns url,\n"
+                "                                  lang, mime, date, digest, text (and html with -f html)\n"
+                " --max-open-languages <n>         Keep the output files of at most <n> languages open (default 64,\n"
+                "                                  0 for no limit), the least recently used are closed and appended\n"
+                "                                  to later\n"
+                " --shards <n>                     Split the output in <n> shards by a stable hash, written to\n"
+                "                                  <lang>/<shard>/ folders (or <name>.<shard>.tsv.gz for tsv output)\n"
+                " --shard-by <key>                 Hash the \"url\" (default) or the \"host\" of records for sharding,\n"
+                "                                  so that documents of a host stay in the same shard\n"
+                " --rotate-bytes <bytes>           Write output in numbered parts (text.0.gz, text.1.gz...), starting\n"
+                "                                  a new one when a file reaches <bytes> compressed bytes; parts are\n"
+                "                                  written as .tmp files and renamed when finished\n"
+                " --rotate-input-bytes <bytes>     Same, after <bytes> uncompressed bytes\n"
+                " --rotate-records <n>             Same, after <n> records\n"
+                " --compression <codecs>           Compression of the output files: gzip (default), zstd, lz4\n"
+                "                                  or none, optionally with a level (\"zstd:19\") and per output\n"
+                "                                  file (\"zstd,html=zstd:19,url=none\")\n"
+                " --compression-threads <n>        Compress output files in independent 1MB blocks\n"
+                "                                  using <n> threads (default 0: single stream)\n"
                 " --encode-urls                    Encode URLs obtained from WARC records\n"
                 " --paragraph-identification       Add paragraph index for each sentence extracted from the html\n"
                 " -s                               Only output errors\n"
@@ -88,19 +205,132 @@ int main(int argc, char *argv[]) {
                                              boost::log::trivial::info;
     boost::log::core::get()->set_filter(boost::log::trivial::severity >= verbosity_level);
 
+    if (!options.compile_domain_filters.empty()) {
+        if (options.domain_filters_filename.empty()) {
+            BOOST_LOG_TRIVIAL(error) << "--compile-domain-filters needs a --domain-filters list";
+            return 1;
+        }
+        try {
+            DomainFilter::compile(options.domain_filters_filename, options.compile_domain_filters);
+        } catch (const WriteError& e) {
+            BOOST_LOG_TRIVIAL(error) << e.what();
+            return 1;
+        }
+        return 0;
+    }
+
+    OutputOptions output;
+    FilterOptions filters;
+    DedupOptions dedup;
+
     // prepare list of output files
     std::vector<std::string> files_list;
     boost::algorithm::split(files_list, options.files, [](char c) {return c == ',';});
-    std::unordered_set<std::string> output_files(files_list.begin(), files_list.end());
+    output.files.insert(files_list.begin(), files_list.end());
+    output.pdf_warc_filename = options.pdf_warc_filename;
+    output.arrow_filename = options.arrow;
+    output.max_open_languages = options.max_open_languages;
+    output.shards = options.shards;
+    output.paragraph_identification = options.paragraph_identification;
+    output.encode_urls = options.encodeURLs;
+
+    // prepare language filters
+    if (!options.langs.empty())
+        boost::algorithm::split(filters.langs, options.langs, [](char c) {return c == ',';});
+    if (!options.reject_langs.empty())
+        boost::algorithm::split(filters.reject_langs, options.reject_langs, [](char c) {return c == ',';});
+    filters.multilang = options.multilang;
+    filters.lid_bytes = options.lid_bytes;
+    filters.tag_filters_file = options.tag_filters_filename;
+    filters.invert_tag_filters = options.tag_filters_invert;
+    filters.url_filters_file = options.url_filters_filename;
+    filters.domain_filters_file = options.domain_filters_filename;
+    filters.boilerplate_threshold = options.boilerplate_threshold;
+    filters.max_docs_per_host = options.max_docs_per_host;
+    filters.sample_rate = options.sample_rate;
+
+    // prepare output compression
+    output.compression.threads = options.compression_threads;
+    try {
+        parseCompression(options.compression, output.compression);
+    } catch (const std::invalid_argument& e) {
+        BOOST_LOG_TRIVIAL(error) << "Invalid --compression: " << e.what();
+        return 1;
+    }
+
+    if (options.text_format == "base64") {
+        output.format = TextFormat::BASE64;
+    } else if (options.text_format == "framed") {
+        output.format = TextFormat::FRAMED;
+    } else {
+        BOOST_LOG_TRIVIAL(error) << "Invalid --text-format: " << options.text_format;
+        return 1;
+    }
+
+    if (options.shard_by == "url") {
+        output.shard_key = ShardKey::URL;
+    } else if (options.shard_by == "host") {
+        output.shard_key = ShardKey::HOST;
+    } else {
+        BOOST_LOG_TRIVIAL(error) << "Invalid --shard-by: " << options.shard_by;
+        return 1;
+    }
+
+    filters.http.min_length = options.min_content_length;
+    filters.http.max_length = options.max_content_length;
+    try {
+        filters.http.parse(options.http_status, options.mimes, options.reject_mimes);
+    } catch (const std::invalid_argument& e) {
+        BOOST_LOG_TRIVIAL(error) << "Invalid --http-status: " << e.what();
+        return 1;
+    }
+
+    output.rotation.bytes = options.rotate_bytes;
+    output.rotation.input_bytes = options.rotate_input_bytes;
+    output.rotation.records = options.rotate_records;
+
+    output.tsv_columns.clear();
+    boost::algorithm::split(output.tsv_columns, options.tsv_columns, [](char c) {return c == ',';});
+    std::string columns_error;
+    if (!BilangWriter::validTSVColumns(output.tsv_columns, columns_error)) {
+        BOOST_LOG_TRIVIAL(error) << "Invalid --tsv-columns: " << columns_error;
+        return 1;
+    }
+
+    if (options.near_dedup_distance > 63) {
+        BOOST_LOG_TRIVIAL(error) << "Invalid --near-dedup-distance: " << options.near_dedup_distance;
+        return 1;
+    }
+    dedup.exact = options.dedup;
+    dedup.exact_table = options.dedup_table;
+    dedup.digest = options.digest_dedup;
+    dedup.digest_table = options.digest_table;
+    dedup.near = options.near_dedup;
+    dedup.near_distance = options.near_dedup_distance;
+
+    if (!(options.sample_rate > 0.0 and options.sample_rate <= 1.0)) {
+        BOOST_LOG_TRIVIAL(error) << "Invalid --sample-rate: " << options.sample_rate;
+        return 1;
+    }
+
+    // a single stream has no room for shards or parts
+    if (options.output == "-" and (options.shards > 1 or output.rotation.enabled())) {
+        BOOST_LOG_TRIVIAL(error) << "--shards and --rotate-* cannot be used with output to stdout";
+        return 1;
+    }
 
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
-    WARCPreprocessor warcpproc(options.output, output_files, options.pdf_warc_filename, options.tag_filters_filename,
-                               options.tag_filters_invert, options.url_filters_filename, options.multilang,
-                               options.encodeURLs, options.paragraph_identification);
-    for (const std::string& file : options.warcs){
-        warcpproc.process(file);
+    try {
+        WARCPreprocessor warcpproc(options.output, output, filters, dedup);
+        for (const std::string& file : options.warcs){
+            warcpproc.process(file);
+        }
+        warcpproc.close();
+        warcpproc.printStatistics();
+    } catch (const WriteError& e) {
+        BOOST_LOG_TRIVIAL(error) << e.what();
+        return 1;
     }
-    warcpproc.printStatistics();
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
     unsigned int hours = std::chrono::duration_cast<std::chrono::hours>(end - start).count();